@@ -0,0 +1,334 @@
+/*
+ * bench.c
+ *
+ * Parser and trigger micro-benchmark for dxlog_mult_listener.
+ *
+ * Feeds synthetic but realistic DXLog / N1MM UDP datagrams through
+ * process_datagram() with console output off and the audio thread
+ * stubbed out (bell triggers are drained and discarded), and reports
+ * ns/datagram, datagrams/s and MB/s for each packet class, for both
+ * the single-pass and the legacy (-L) parser.
+ *
+ * Build and run:
+ *   make bench
+ *
+ * Options:
+ *   -t ms   target run time per measurement (default 200 ms)
+ *   -S      scalar <contactinfo> search instead of SSE2/NEON
+ */
+
+#define LISTENER_NO_MAIN
+#include "listener.c"
+
+/* ------------------------------------------------------------------ */
+/*  Packet classes                                                      */
+/* ------------------------------------------------------------------ */
+
+/* DXLog contactinfo, as logged on a networked run station.  The
+   DXLog-specific mult/newqso fields come last, so a parser that scans
+   for them sees the whole document. */
+static const char contactinfo_fmt[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+    "<contactinfo>\r\n"
+    "\t<app>DXLog</app>\r\n"
+    "\t<contestname>CQWWCW</contestname>\r\n"
+    "\t<contestnr>73</contestnr>\r\n"
+    "\t<timestamp>2026-11-28 14:02:11</timestamp>\r\n"
+    "\t<mycall>SM7IUN</mycall>\r\n"
+    "\t<band>14</band>\r\n"
+    "\t<rxfreq>1402512</rxfreq>\r\n"
+    "\t<txfreq>1402512</txfreq>\r\n"
+    "\t<operator>SM7IUN</operator>\r\n"
+    "\t<mode>CW</mode>\r\n"
+    "\t<call>JA1ABC</call>\r\n"
+    "\t<countryprefix>JA</countryprefix>\r\n"
+    "\t<wpxprefix>JA1</wpxprefix>\r\n"
+    "\t<stationprefix>SM7IUN</stationprefix>\r\n"
+    "\t<continent>AS</continent>\r\n"
+    "\t<snt>599</snt>\r\n"
+    "\t<sntnr>1234</sntnr>\r\n"
+    "\t<rcv>599</rcv>\r\n"
+    "\t<rcvnr>0</rcvnr>\r\n"
+    "\t<gridsquare></gridsquare>\r\n"
+    "\t<exchange1>25</exchange1>\r\n"
+    "\t<section></section>\r\n"
+    "\t<comment>%s</comment>\r\n"
+    "\t<qth></qth>\r\n"
+    "\t<name></name>\r\n"
+    "\t<power></power>\r\n"
+    "\t<misctext></misctext>\r\n"
+    "\t<zone>25</zone>\r\n"
+    "\t<prec></prec>\r\n"
+    "\t<ck>0</ck>\r\n"
+    "\t<ismultiplier1>%d</ismultiplier1>\r\n"
+    "\t<ismultiplier2>%d</ismultiplier2>\r\n"
+    "\t<ismultiplier3>0</ismultiplier3>\r\n"
+    "\t<points>3</points>\r\n"
+    "\t<radionr>1</radionr>\r\n"
+    "\t<run1run2>1</run1run2>\r\n"
+    "\t<RoverLocation></RoverLocation>\r\n"
+    "\t<RadioInterfaced>1</RadioInterfaced>\r\n"
+    "\t<NetworkedCompNr>2</NetworkedCompNr>\r\n"
+    "\t<IsOriginal>True</IsOriginal>\r\n"
+    "\t<NetBiosName>RUN1</NetBiosName>\r\n"
+    "\t<IsRunQSO>1</IsRunQSO>\r\n"
+    "\t<StationName>RUN1</StationName>\r\n"
+    "\t<ID>f9ffac4fcd3e479ca86e137df1338531</ID>\r\n"
+    "\t<IsClaimedQso>True</IsClaimedQso>\r\n"
+    "\t<mult1>%s</mult1>\r\n"
+    "\t<mult2>%s</mult2>\r\n"
+    "\t<mult3></mult3>\r\n"
+    "\t<newqso>true</newqso>\r\n"
+    "\t<xqso>false</xqso>\r\n"
+    "</contactinfo>\r\n";
+
+static const char radioinfo[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+    "<RadioInfo>\r\n"
+    "\t<app>DXLog</app>\r\n"
+    "\t<StationName>RUN1</StationName>\r\n"
+    "\t<RadioNr>1</RadioNr>\r\n"
+    "\t<Freq>1402512</Freq>\r\n"
+    "\t<TXFreq>1402512</TXFreq>\r\n"
+    "\t<Mode>CW</Mode>\r\n"
+    "\t<OpCall>SM7IUN</OpCall>\r\n"
+    "\t<IsRunning>True</IsRunning>\r\n"
+    "\t<FocusEntry>1</FocusEntry>\r\n"
+    "\t<EntryWindowHwnd>0</EntryWindowHwnd>\r\n"
+    "\t<Antenna>1</Antenna>\r\n"
+    "\t<Rotors></Rotors>\r\n"
+    "\t<FocusRadioNr>1</FocusRadioNr>\r\n"
+    "\t<IsStereo>False</IsStereo>\r\n"
+    "\t<IsSplit>False</IsSplit>\r\n"
+    "\t<ActiveRadioNr>1</ActiveRadioNr>\r\n"
+    "\t<IsTransmitting>False</IsTransmitting>\r\n"
+    "\t<FunctionKeyCaption></FunctionKeyCaption>\r\n"
+    "\t<RadioName>K3</RadioName>\r\n"
+    "\t<AuxAntSelected>-1</AuxAntSelected>\r\n"
+    "\t<AuxAntSelectedName></AuxAntSelectedName>\r\n"
+    "\t<IsConnected>True</IsConnected>\r\n"
+    "</RadioInfo>\r\n";
+
+static const char spot[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+    "<spot>\r\n"
+    "\t<app>DXLog</app>\r\n"
+    "\t<StationName>MULT1</StationName>\r\n"
+    "\t<dxcall>VK9XX</dxcall>\r\n"
+    "\t<frequency>14025.3</frequency>\r\n"
+    "\t<spottercall>DL1ABC-#</spottercall>\r\n"
+    "\t<comment>CW 23 dB 28 WPM CQ</comment>\r\n"
+    "\t<action>add</action>\r\n"
+    "\t<mode>CW</mode>\r\n"
+    "\t<status>Mult</status>\r\n"
+    "\t<timestamp>2026-11-28 14:02:09</timestamp>\r\n"
+    "</spot>\r\n";
+
+/* dynamicresults (score) packets grow with the number of bands */
+static int build_score(char *buf, size_t size, int bands)
+{
+    static const char *band_name[] = {
+        "160", "80", "40", "20", "15", "10", "6", "2"
+    };
+    int n = snprintf(buf, size,
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+        "<dynamicresults>\r\n"
+        "\t<contest>CQWWCW</contest>\r\n"
+        "\t<call>SM7IUN</call>\r\n"
+        "\t<ops>SM7IUN SM7XYZ</ops>\r\n"
+        "\t<class power=\"HIGH\" assisted=\"ASSISTED\" transmitter=\"TWO\" "
+        "ops=\"MULTI\" bands=\"ALL\" mode=\"CW\"/>\r\n"
+        "\t<club>SK7AX</club>\r\n"
+        "\t<soft>DXLog</soft>\r\n"
+        "\t<version>2.6.10</version>\r\n"
+        "\t<qth><dxcccountry>SM</dxcccountry><cqzone>14</cqzone>"
+        "<iaruzone>18</iaruzone><arrlsection>DX</arrlsection>"
+        "<grid6>JO65</grid6></qth>\r\n"
+        "\t<breakdown>\r\n");
+    for (int r = 0; r < 4; r++)
+        for (int b = 0; b < bands; b++)
+            n += snprintf(buf + n, size - (size_t)n,
+                "\t\t<qso band=\"%s\" mode=\"CW\">%d</qso>"
+                "<point band=\"%s\" mode=\"CW\">%d</point>"
+                "<mult band=\"%s\" mode=\"CW\" type=\"dxcc\">%d</mult>"
+                "<mult band=\"%s\" mode=\"CW\" type=\"zone\">%d</mult>\r\n",
+                band_name[b], 100 + 37 * b + r, band_name[b], 300 + 91 * b,
+                band_name[b], 40 + b, band_name[b], 12 + b);
+    n += snprintf(buf + n, size - (size_t)n,
+        "\t</breakdown>\r\n"
+        "\t<score>2345678</score>\r\n"
+        "\t<timestamp>2026-11-28 14:02:00</timestamp>\r\n"
+        "</dynamicresults>\r\n");
+    return n;
+}
+
+struct packet_class {
+    const char   *name;
+    enum msg_type type;          /* what msg_root() must make of it    */
+    char          buf[16384];
+    size_t        len;
+};
+
+static struct packet_class g_classes[16];
+static int                 g_nclasses;
+
+static struct packet_class *add_class(const char *name, enum msg_type type)
+{
+    struct packet_class *c = &g_classes[g_nclasses++];
+    c->name = name;
+    c->type = type;
+    return c;
+}
+
+static void build_classes(void)
+{
+    static char long_comment[2048];
+    memset(long_comment, 'x', sizeof(long_comment) - 1);
+
+    struct packet_class *c;
+
+    c = add_class("contactinfo, new mult", MSG_CONTACT);
+    c->len = (size_t)snprintf(c->buf, sizeof(c->buf), contactinfo_fmt,
+                              "", 1, 1, "JA", "25");
+    c = add_class("contactinfo, no mult", MSG_CONTACT);
+    c->len = (size_t)snprintf(c->buf, sizeof(c->buf), contactinfo_fmt,
+                              "", 0, 0, "", "");
+    c = add_class("contactinfo, 2 KB comment", MSG_CONTACT);
+    c->len = (size_t)snprintf(c->buf, sizeof(c->buf), contactinfo_fmt,
+                              long_comment, 0, 0, "", "");
+    c = add_class("RadioInfo", MSG_RADIO);
+    c->len = (size_t)snprintf(c->buf, sizeof(c->buf), "%s", radioinfo);
+    c = add_class("spot", MSG_SPOT);
+    c->len = (size_t)snprintf(c->buf, sizeof(c->buf), "%s", spot);
+    c = add_class("score, 2 bands", MSG_SCORE);
+    c->len = (size_t)build_score(c->buf, sizeof(c->buf), 2);
+    c = add_class("score, 8 bands", MSG_SCORE);
+    c->len = (size_t)build_score(c->buf, sizeof(c->buf), 8);
+
+    /* A known root's name with more after it is another element */
+    c = add_class("<contactinfox>", MSG_NONE);
+    c->len = (size_t)snprintf(c->buf, sizeof(c->buf),
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+        "<contactinfox><call>SM7IUN</call><mult1>JA</mult1>"
+        "<newqso>true</newqso></contactinfox>\r\n");
+    c = add_class("<RadioInfo_x>", MSG_NONE);
+    c->len = (size_t)snprintf(c->buf, sizeof(c->buf),
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+        "<RadioInfo_x><Freq>1402512</Freq></RadioInfo_x>\r\n");
+}
+
+/* ------------------------------------------------------------------ */
+/*  Measurement                                                         */
+/* ------------------------------------------------------------------ */
+static double mono_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Stand-in for the audio thread: discard queued bells */
+static void drain_triggers(void)
+{
+    struct trigger_event ev;
+    while (spsc_pop(&g_trigger_ring, &ev) == 0)
+        ;
+}
+
+/* Every class repeats one packet; forget it so each iteration takes
+   the full ring path instead of the duplicate shortcut. */
+static void forget_contacts(void)
+{
+    struct dedup_cache *d = &g_state->dedup;
+    while (d->count) {
+        dedup_erase(d, d->ring[d->head]);
+        d->head = (d->head + 1) & (DEDUP_ENTRIES - 1);
+        d->count--;
+    }
+}
+
+static void run_batch(const struct packet_class *c,
+                      const struct sockaddr_storage *src, unsigned long n)
+{
+    for (unsigned long i = 0; i < n; i++) {
+        struct timespec rx;
+        clock_gettime(CLOCK_REALTIME, &rx);
+        process_datagram(c->buf, c->len, src, &rx);
+        drain_triggers();
+        forget_contacts();
+    }
+}
+
+/* Double the batch until it takes at least target_s, then report. */
+static void measure(const struct packet_class *c, double target_s)
+{
+    struct sockaddr_storage src;
+    struct sockaddr_in     *in = (struct sockaddr_in *)&src;
+    memset(&src, 0, sizeof(src));
+    in->sin_family      = AF_INET;
+    in->sin_addr.s_addr = htonl(0xC0A80102);      /* 192.168.1.2 */
+
+    /* The legacy parser knows only <contactinfo> */
+    struct timespec rx0 = { 0 };
+    enum msg_type   got = process_datagram(c->buf, c->len, &src, &rx0);
+    drain_triggers();
+    forget_contacts();
+    if (!g_legacy_parser && got != c->type) {
+        fprintf(stderr, "%s: dispatched as %s, not %s\n", c->name,
+                msg_roots[got].root, msg_roots[c->type].root);
+        exit(1);
+    }
+
+    run_batch(c, &src, 1000);                     /* warm up */
+
+    unsigned long n = 1000;
+    double        t;
+    for (;;) {
+        double t0 = mono_s();
+        run_batch(c, &src, n);
+        t = mono_s() - t0;
+        if (t >= target_s || n >= (1ul << 30)) break;
+        n *= 2;
+    }
+
+    double ns = t * 1e9 / (double)n;
+    printf("  %-28s %6zu B %10.1f ns %12.0f dgram/s %9.1f MB/s\n",
+           c->name, c->len, ns, (double)n / t,
+           (double)n * (double)c->len / t / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    double target_ms    = 200.0;
+    int    force_scalar = 0;
+    int    opt;
+    while ((opt = getopt(argc, argv, "t:Sh")) != -1) {
+        switch (opt) {
+        case 't': target_ms = strtod(optarg, NULL); break;
+        case 'S': force_scalar = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-t ms] [-S]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    find_tag_select(force_scalar);
+    g_quiet = 1;
+    if (spsc_init(&g_trigger_ring, AUDIO_QUEUE_LEN,
+                  sizeof(struct trigger_event)) < 0 ||
+        sem_init(&g_audio_wake, 0, 0) < 0) {
+        perror("init");
+        return 1;
+    }
+    build_classes();
+
+    printf("Tag scan: %s\n", find_tag_name);
+    for (int legacy = 0; legacy <= 1; legacy++) {
+        g_legacy_parser = legacy;
+        printf("\nParser: %s\n",
+               legacy ? "legacy (rescan per field)" : "single pass");
+        for (int i = 0; i < g_nclasses; i++)
+            measure(&g_classes[i], target_ms / 1e3);
+    }
+    return 0;
+}
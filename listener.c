@@ -1,72 +1,358 @@
 /*
  * dxlog_mult_listener.c
  *
- * Listens for DXLog UDP datagrams on port 9888.
- * Plays a beep/sound whenever mult1, mult2, or mult3 is non-empty.
+ * Listens for DXLog (and N1MM) UDP datagrams, on UDP port 12060 of
+ * every IPv4 address unless 'port' or 'listen' in the config file
+ * says otherwise.  Rings a bell for a new contact (newqso = true)
+ * with mult1, mult2 or mult3 non-empty; with trigger = local, only
+ * for a mult value not seen before on that band and mode.
  *
- * Sound options (choose ONE by setting SOUND_MODE below):
+ * The bell is a WAV file or a synthesised tone, chosen by
+ * "sound = wav | tone" in the config file.  SOUND_MODE below only
+ * sets the built-in default:
  *
- *   SOUND_MODE_WAV   — play a WAV file via aplay
- *   SOUND_MODE_BEEP  — synthesise a tone in memory and play it via aplay
- *   SOUND_MODE_ALSA  — synthesise a tone directly through ALSA (no aplay,
- *                       requires libasound2-dev)
+ *   SOUND_MODE_WAV   — the bell is WAV_FILE
+ *   SOUND_MODE_BEEP  — the bell is a BEEP_FREQ_HZ tone
+ *   SOUND_MODE_ALSA  — a tone, preferring the ALSA backend to the
+ *                       probed fastest (requires libasound2-dev)
  *
- * Build (WAV or BEEP mode — no extra libs):
- *   gcc -O2 -Wall -o dxlog_mult_listener dxlog_mult_listener.c -lm
+ * Output backends, all compiled in (ALSA when libasound is found):
  *
- * Build (ALSA mode):
- *   gcc -O2 -Wall -o dxlog_mult_listener dxlog_mult_listener.c -lm -lasound
+ *   alsa   — PCM written straight to ALSA
+ *   aplay  — PCM streamed to one persistent aplay process
+ *   fork   — "aplay file &" per bell (WAV only, the original method)
+ *
+ * At startup each backend is probed for its trigger-to-first-sample
+ * latency and the fastest working one is used; if it fails later, the
+ * next one takes over.
+ *
+ * Bells are mixed in-process (up to MIX_VOICES at once) onto a single
+ * persistent output stream, so overlapping bells neither queue up nor
+ * fight over the sound device.
+ *
+ * Build:
+ *   make                 (adds -DHAVE_ALSA -lasound if libasound2-dev
+ *                         is installed)
+ * or by hand:
+ *   gcc -O2 -Wall -pthread -o dxlog_mult_listener dxlog_mult_listener.c -lm
+ *   gcc -O2 -Wall -pthread -DHAVE_ALSA -o dxlog_mult_listener \
+ *       dxlog_mult_listener.c -lm -lasound
  *
  * Run:
- *   ./dxlog_mult_listener
+ *   ./dxlog_mult_listener [-b batch] [-L] [-S] [-F] [-q] [-l file]
+ *                         [-w file] [-r file [-x speed]] [-C file]
+ *                         [-c ms] [-m strikes] [-R bells] [-s file]
+ *                         [-W workers] [-U]
+ *
+ *   -b N   receive up to N datagrams per recvmmsg() call (default 16,
+ *          1 = one recvmsg() per datagram).  The average number of
+ *          datagrams per call is printed on exit (Ctrl-C).
+ *   -L     use the legacy parser: a search for <contactinfo> anywhere,
+ *          then xml_get_field(), which rescans the whole datagram for
+ *          every field, instead of the root-element dispatch and the
+ *          single-pass xml_scan_fields().  Kept for side-by-side
+ *          benchmarking; it knows no other message type.
+ *   -S     use the scalar <contactinfo> search (-L) even when SSE2
+ *          (x86) or NEON (Pi 4) is available.
+ *   -F     use the fork backend ("aplay file &" per bell) instead
+ *          of the probed fastest one; same as backend = fork.
+ *   -q     do not print a line for every contactinfo, contactreplace
+ *          and contactdelete datagram.
+ *   -l F   append those lines to F instead of stdout.  They are
+ *          written by a background thread; if it falls behind, lines
+ *          are dropped (and counted) rather than delaying the bell.
+ *   -w F   append every received datagram (receive time, source,
+ *          payload) to the capture file F.
+ *   -r F   replay capture file F through the parser and trigger
+ *          instead of listening, then print the throughput.
+ *   -x N   replay at N times the recorded pace (default 1);
+ *          0 replays as fast as possible.
+ *   -C F   read settings from F instead of ./multiplierbell.conf.
+ *   -c MS  a bell opens an MS window (default 400); triggers inside it
+ *          ring together as one bell when it closes.  0 = no window.
+ *   -m N   strike a coalesced bell up to N times, one per trigger
+ *          (default 3, 1 = always a single strike).
+ *   -R N   ring at most N bells per minute, bursts of BELL_BURST
+ *          (default 20, 0 = no limit).  Excess triggers are dropped.
+ *   -s F   keep the persistent state in F instead of
+ *          ./multiplierbell.state; -s "" keeps it in memory only.
+ *   -W N   receive and parse on N worker threads (default 0 = on the
+ *          main thread); same as workers = N.  Only unicast senders
+ *          are spread over them: every broadcast is parsed by worker
+ *          0, so DXLog's usual broadcast setup gains nothing.
+ *   -U     receive through io_uring instead of recvmmsg(); same as
+ *          receive = io_uring.  Falls back when the kernel is older
+ *          than 6.0 or io_uring is disabled.
+ *
+ * Port, sound (wav or tone), WAV file, tone, output device and the
+ * bell scheduling settings can be set in the config file, which is
+ * watched and re-read whenever it is saved; the new settings take
+ * effect without a restart.  See "Configuration file" below.
+ *
+ * 'listen' in the config file takes several ports, addresses (IPv4
+ * or IPv6) and interfaces at once, e.g. DXLog on one port and another
+ * logger's broadcasts on a second; one epoll loop serves them all,
+ * and per-socket counts are printed on exit and on SIGUSR1.
+ *
+ * Per-stage latency percentiles (kernel receive -> parsed -> trigger ->
+ * first sample queued) are printed on exit and on SIGUSR1:
+ *   kill -USR1 $(pidof dxlog_mult_listener)
+ *
+ * Datagrams the kernel drops because the socket's receive buffer is
+ * full are counted (SO_RXQ_OVFL).  Every stats_interval seconds, and
+ * on SIGUSR1, a line gives the datagrams received and dropped and the
+ * contacts and bells since the last one; raise rcvbuf in the config
+ * file if drops show up.
+ *
+ * A contact that arrives again (same <ID>, or same call, band, mode,
+ * station and timestamp) within DEDUP_WINDOW_S does not ring twice.
+ *
+ * Every mult value of a new contact is indexed per band and mode, and
+ * the totals are printed on exit and on SIGUSR1.  With trigger = local
+ * in the config file the bell rings only for a value this index has
+ * not seen yet on that band and mode, not on DXLog's say-so alone.
+ *
+ * mult1_sound .. mult3_sound in the config file give a new mult in
+ * that slot its own sound (a WAV file or a tone) instead of the bell.
+ * All sounds are decoded or rendered when the config is loaded, so a
+ * bell only looks its sound up in a table.
+ *
+ * The duplicate cache, the mult index and a few counters are
+ * kept in the memory-mapped file STATE_FILE (or -s file) and updated
+ * in place, so after a restart or reboot the listener carries on where
+ * it stopped.  A file from another version is started over.
+ *
+ * With workers = N (or -W N) each of N threads, pinned to its own
+ * core, has a SO_REUSEPORT socket per listen endpoint and parses what
+ * the kernel hands it; the main thread takes the parsed contacts in
+ * receive-time order and does the mult index, dedup and bell.  The
+ * kernel spreads senders over the sockets by address and port, so this
+ * pays off with traffic from several stations or networks; one sender
+ * always lands on the same worker.  Every socket gets a copy of a
+ * broadcast, so broadcasts are parsed by worker 0 alone.
+ *
+ * With receive = io_uring (or -U) every socket has one multishot
+ * recvmsg outstanding that fills buffers from a ring registered with
+ * the kernel; datagrams are picked up from the completion queue
+ * without a system call each, and each buffer is handed back once its
+ * datagram has been handled.
+ *
+ * Datagrams are told apart by their root element, found in the first
+ * ROOT_SCAN bytes and looked up in a perfect hash: contactinfo can
+ * ring, contactreplace (an edited contact) adds its mults to the
+ * index and is logged, contactdelete is logged, and RadioInfo, spot
+ * and dynamicresults are only counted, so however large they are they
+ * cost next to nothing.  Counts per type are printed on exit and on
+ * SIGUSR1.
+ *
+ * filter = on in the config file attaches a classic BPF program to
+ * every socket, so the kernel itself drops datagrams from outside the
+ * 'allow' networks, longer than max_length, or without a root element
+ * the listener reads, before they are queued or wake the listener.
+ * The kernel counts those as drops, so the reports say "filtered or
+ * dropped" then.  Every family listened on needs an 'allow' network
+ * when the list is given, and -L turns the filter off, since the
+ * legacy parser takes <contactinfo> anywhere in a datagram.
  *
  * Raspberry Pi OS (Bullseye / Bookworm), Raspberry Pi 4.
  * Make sure audio output is configured:
  *   sudo raspi-config  →  System Options → Audio
  */
 
+#define _GNU_SOURCE     /* recvmmsg() */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
 #include <math.h>
 #include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <libgen.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <net/if.h>
+#include <ifaddrs.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <linux/filter.h>
+
+/* io_uring receive backend: needs the 6.0 headers (multishot recvmsg) */
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#ifdef IORING_RECV_MULTISHOT
+#define HAVE_URING 1
+#endif
+#endif
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#if !defined(__aarch64__)
+#include <asm/hwcap.h>      /* HWCAP_NEON on 32-bit ARM */
+#endif
+#endif
 
 /* ------------------------------------------------------------------ */
 /*  Sound mode — pick exactly one                                       */
+/*                                                                      */
+/*  The mode sets the default sound and, for SOUND_MODE_ALSA, the     */
+/*  default backend; "sound" and "backend" in the config file         */
+/*  override both.                                                     */
 /* ------------------------------------------------------------------ */
-#define SOUND_MODE_WAV   0   /* play a WAV file with aplay             */
-#define SOUND_MODE_BEEP  1   /* generate a tone, pipe it to aplay      */
-#define SOUND_MODE_ALSA  2   /* generate a tone via ALSA directly       */
+#define SOUND_MODE_WAV   0   /* the bell is WAV_FILE                   */
+#define SOUND_MODE_BEEP  1   /* the bell is a tone                     */
+#define SOUND_MODE_ALSA  2   /* a tone, backend = alsa                 */
 
 #define SOUND_MODE SOUND_MODE_WAV   /* ← change this to suit         */
 
 /* ------------------------------------------------------------------ */
 /*  Configuration                                                        */
+/*                                                                      */
+/*  Built-in defaults.  Most can be changed without rebuilding in     */
+/*  CONFIG_FILE (or -C file), which is re-read whenever it changes.   */
 /* ------------------------------------------------------------------ */
+#define CONFIG_FILE   "./multiplierbell.conf"
+
+/* Dedup cache, mult index and counters, kept across restarts; -s */
+#define STATE_FILE    "./multiplierbell.state"
+
 #define LISTEN_PORT   12060
+#define LISTEN_MAX    8         /* sockets in one 'listen' list       */
+
+/* Datagrams fetched per recvmmsg() call.  1 falls back to one
+   recvmsg() per datagram.  Override at run time with -b N. */
+#define RECV_BATCH      16
+#define RECV_BATCH_MAX  64
+#define RECV_SLOT_SIZE  65536   /* bytes per receive slot (max UDP)  */
+
+/* Socket receive buffer (SO_RCVBUF) in bytes, 0 = kernel default.
+   What the kernel grants is capped by net.core.rmem_max unless the
+   listener may use SO_RCVBUFFORCE; the effective size is printed. */
+#define RECV_BUFFER     0
+
+/* Print received / kernel-dropped / processed counts every this many
+   seconds (0 = only on exit and SIGUSR1). */
+#define STATS_INTERVAL_S  60
 
-/* Used only in SOUND_MODE_WAV: */
+/* Receive threads, each on its own core with its own SO_REUSEPORT
+   sockets, feeding one trigger stage.  0 = receive, parse and trigger
+   all on the main thread. */
+#define RECV_WORKERS    0
+#define WORKER_MAX      8
+
+/* Played when sound = wav (default in SOUND_MODE_WAV): */
 #define WAV_FILE      "./handbell.wav"
 
-/* Used in SOUND_MODE_BEEP and SOUND_MODE_ALSA: */
+/* Played when sound = tone (default in SOUND_MODE_BEEP and _ALSA): */
 #define BEEP_FREQ_HZ    880     /* tone frequency  (Hz)               */
 #define BEEP_DURATION   400     /* tone duration   (ms)               */
 #define BEEP_VOLUME     0.6     /* 0.0 – 1.0                          */
 
-/* ALSA device (SOUND_MODE_ALSA only). "default" usually works.
+/* Duplicate suppression: remember the last DEDUP_ENTRIES bell-worthy
+   contacts (power of two) for up to DEDUP_WINDOW_S seconds (0 = no
+   time limit).  A contact seen again in that window does not ring. */
+#define DEDUP_ENTRIES   4096
+#define DEDUP_WINDOW_S  (6 * 3600)
+
+/* Tone sample rate, unless the output already runs at another */
+#define SAMPLE_RATE     44100
+
+/* Bells that can sound at once; a further trigger restarts the
+   oldest.  The mixer writes MIX_PERIOD frames at a time. */
+#define MIX_VOICES      8
+#define MIX_PERIOD      512
+
+/* Pending bell triggers between the receive and audio threads
+   (power of two).  Triggers beyond this are dropped and counted. */
+#define AUDIO_QUEUE_LEN 64
+
+/* Bell scheduling.  A trigger rings at once; triggers that follow
+   within COALESCE_MS of a bell are held and rung together as one bell
+   when the window closes, struck up to MULTI_RING_MAX times (spaced
+   MULTI_RING_GAP_MS apart) to hint at how many arrived.  At most
+   BELLS_PER_MIN bells a minute ring, with bursts of up to BELL_BURST
+   (0 = no limit); triggers over the limit are counted and dropped. */
+#define COALESCE_MS        400
+#define MULTI_RING_MAX     3
+#define MULTI_RING_GAP_MS  150
+#define BELLS_PER_MIN      20
+#define BELL_BURST         4
+
+/* Output device, for ALSA or aplay -D.  "default" usually works.
    Use "plughw:0,0" to target the Pi's built-in audio. */
 #define ALSA_DEVICE   "default"
 
+/* ------------------------------------------------------------------ */
+/*  Allocation debug counter (build with: make ALLOC_DEBUG=1)          */
+/*                                                                      */
+/*  Replaces malloc/calloc/realloc with counting wrappers around the   */
+/*  glibc implementations.  Once a thread calls ALLOC_STEADY(), any   */
+/*  further allocation on that thread is counted and trips an assert. */
+/*  The receive thread marks itself steady just before its loop.      */
+/* ------------------------------------------------------------------ */
+#ifdef ALLOC_DEBUG
+#include <assert.h>
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+static __thread int        t_alloc_steady;
+static atomic_ulong        g_alloc_count;
+static atomic_ulong        g_alloc_late;
+
+static void alloc_note(void)
+{
+    atomic_fetch_add_explicit(&g_alloc_count, 1, memory_order_relaxed);
+    if (t_alloc_steady) {
+        atomic_fetch_add_explicit(&g_alloc_late, 1, memory_order_relaxed);
+        t_alloc_steady = 0;     /* assert() itself allocates */
+        assert(!"heap allocation on the receive path after startup");
+    }
+}
+
+void *malloc(size_t n)             { alloc_note(); return __libc_malloc(n); }
+void *calloc(size_t n, size_t sz)  { alloc_note(); return __libc_calloc(n, sz); }
+void *realloc(void *p, size_t n)   { alloc_note(); return __libc_realloc(p, n); }
+
+#define ALLOC_STEADY()  (t_alloc_steady = 1)
+#else
+#define ALLOC_STEADY()  ((void)0)
+#endif
+
 /* ------------------------------------------------------------------ */
 /*  ALSA headers (only compiled when SOUND_MODE == SOUND_MODE_ALSA)    */
 /* ------------------------------------------------------------------ */
-#if SOUND_MODE == SOUND_MODE_ALSA
+#if SOUND_MODE == SOUND_MODE_ALSA && !defined(HAVE_ALSA)
+#define HAVE_ALSA
+#endif
+#ifdef HAVE_ALSA
 #include <alsa/asoundlib.h>
 #endif
 
@@ -75,9 +361,24 @@
 /*                                                                      */
 /*  Finds <tag>value</tag> regardless of the capitalisation used in    */
 /*  the XML.  Returns 1 on success, 0 if the tag is not found.        */
+/*  The value is returned as a whitespace-trimmed slice pointing into  */
+/*  xml[0..len); nothing is copied and xml need not be NUL-terminated. */
+/*                                                                      */
+/*  Rescans the document from the start for every tag.  Only used     */
+/*  with -L; see xml_scan_fields() for the single-pass version.       */
 /* ================================================================== */
-static int xml_get_field(const char *xml, const char *tag,
-                         char *buf, size_t buflen)
+struct xml_slice {
+    const char *p;
+    size_t      len;
+};
+
+static int is_xml_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int xml_get_field(const char *xml, size_t len, const char *tag,
+                         struct xml_slice *out)
 {
     char open_tag[64], close_tag[64];
     snprintf(open_tag,  sizeof(open_tag),  "<%s>",  tag);
@@ -85,10 +386,11 @@ static int xml_get_field(const char *xml, const char *tag,
 
     size_t otlen = strlen(open_tag);
     size_t ctlen = strlen(close_tag);
+    const char *xend = xml + len;
 
     /* Case-insensitive search for opening tag */
     const char *start = NULL;
-    for (const char *p = xml; *p; p++) {
+    for (const char *p = xml; p + otlen <= xend; p++) {
         if (strncasecmp(p, open_tag, otlen) == 0) {
             start = p + otlen;
             break;
@@ -98,7 +400,7 @@ static int xml_get_field(const char *xml, const char *tag,
 
     /* Case-insensitive search for closing tag */
     const char *end = NULL;
-    for (const char *p = start; *p; p++) {
+    for (const char *p = start; p + ctlen <= xend; p++) {
         if (strncasecmp(p, close_tag, ctlen) == 0) {
             end = p;
             break;
@@ -106,273 +408,5109 @@ static int xml_get_field(const char *xml, const char *tag,
     }
     if (!end) return 0;
 
-    size_t len = (size_t)(end - start);
-    if (len >= buflen) len = buflen - 1;
-    memcpy(buf, start, len);
-    buf[len] = '\0';
-
-    /* Trim leading whitespace */
-    char *p = buf;
-    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
-    if (p != buf) memmove(buf, p, strlen(p) + 1);
-
-    /* Trim trailing whitespace */
-    char *e = buf + strlen(buf) - 1;
-    while (e >= buf && (*e == ' ' || *e == '\t' || *e == '\r' || *e == '\n'))
-        *e-- = '\0';
+    /* Trim leading and trailing whitespace */
+    while (start < end && is_xml_space(*start))  start++;
+    while (end > start && is_xml_space(end[-1])) end--;
 
+    out->p   = start;
+    out->len = (size_t)(end - start);
     return 1;
 }
 
 /* ================================================================== */
-/*  Sound implementations                                               */
+/*  Case-insensitive tag search                                         */
+/*                                                                      */
+/*  Finds the first occurrence of 'tag' (which must start with '<')   */
+/*  in buf[0..len).  The vector versions test 16 bytes at a time for  */
+/*  '<' and only compare the rest of the tag at those candidates.     */
+/*  find_tag points at the best version for this CPU, chosen once by  */
+/*  find_tag_select() at startup.                                      */
 /* ================================================================== */
+typedef const char *(*find_tag_fn)(const char *buf, size_t len,
+                                   const char *tag, size_t taglen);
 
-/* ---- WAV file via aplay ------------------------------------------ */
-#if SOUND_MODE == SOUND_MODE_WAV
-static void play_sound(void)
+static const char *find_tag_scalar(const char *buf, size_t len,
+                                   const char *tag, size_t taglen)
 {
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "aplay -q '%s' &", WAV_FILE);
-    if (system(cmd) != 0)
-        fprintf(stderr, "Warning: aplay returned error\n");
+    if (len < taglen) return NULL;
+    const char *last = buf + len - taglen;
+    for (const char *p = buf;
+         p <= last && (p = memchr(p, '<', (size_t)(last - p) + 1)) != NULL;
+         p++) {
+        if (strncasecmp(p + 1, tag + 1, taglen - 1) == 0)
+            return p;
+    }
+    return NULL;
 }
-#endif
 
-/* ---- Generate tone, pipe raw PCM to aplay ------------------------- */
-#if SOUND_MODE == SOUND_MODE_BEEP
+#if defined(__SSE2__)
+static const char *find_tag_sse2(const char *buf, size_t len,
+                                 const char *tag, size_t taglen)
+{
+    if (len < taglen) return NULL;
+    const size_t  last = len - taglen;     /* last valid start offset */
+    const __m128i lt   = _mm_set1_epi8('<');
+    size_t i = 0;
 
-#define SAMPLE_RATE 44100
+    for (; i + 16 <= len; i += 16) {
+        __m128i  v    = _mm_loadu_si128((const __m128i *)(buf + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lt));
+        while (mask) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (at > last) return NULL;
+            if (strncasecmp(buf + at + 1, tag + 1, taglen - 1) == 0)
+                return buf + at;
+            mask &= mask - 1;
+        }
+    }
+    if (i > last) return NULL;
+    return find_tag_scalar(buf + i, len - i, tag, taglen);
+}
+#endif
 
-static void play_sound(void)
+#if defined(__ARM_NEON)
+static const char *find_tag_neon(const char *buf, size_t len,
+                                 const char *tag, size_t taglen)
 {
-    int num_samples = (int)((SAMPLE_RATE * BEEP_DURATION) / 1000);
-    short *samples = malloc((size_t)num_samples * sizeof(short));
-    if (!samples) { perror("malloc"); return; }
-
-    for (int i = 0; i < num_samples; i++) {
-        /* Sine wave with a short linear fade-in/out to avoid clicks */
-        double t      = (double)i / SAMPLE_RATE;
-        double fade   = 1.0;
-        int    fadelen = SAMPLE_RATE / 50;   /* 20 ms */
-        if (i < fadelen)
-            fade = (double)i / fadelen;
-        else if (i > num_samples - fadelen)
-            fade = (double)(num_samples - i) / fadelen;
+    if (len < taglen) return NULL;
+    const size_t     last = len - taglen;
+    const uint8x16_t lt   = vdupq_n_u8('<');
+    size_t i = 0;
 
-        double s  = BEEP_VOLUME * fade * sin(2.0 * M_PI * BEEP_FREQ_HZ * t);
-        samples[i] = (short)(s * 32767.0);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *)(buf + i)), lt);
+        /* Narrow to a 64-bit mask with 4 bits per input byte */
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+                            vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        while (mask) {
+            size_t at = i + (size_t)(__builtin_ctzll(mask) >> 2);
+            if (at > last) return NULL;
+            if (strncasecmp(buf + at + 1, tag + 1, taglen - 1) == 0)
+                return buf + at;
+            mask &= ~(0xFULL << ((at - i) << 2));
+        }
     }
+    if (i > last) return NULL;
+    return find_tag_scalar(buf + i, len - i, tag, taglen);
+}
+#endif
 
-    /*
-     * Pipe raw signed 16-bit little-endian mono 44100 Hz PCM to aplay.
-     * aplay -t raw -f S16_LE -r 44100 -c 1
-     */
-    FILE *p = popen("aplay -q -t raw -f S16_LE -r 44100 -c 1 2>/dev/null", "w");
-    if (!p) {
-        perror("popen aplay");
-        free(samples);
-        return;
+static find_tag_fn find_tag      = find_tag_scalar;
+static const char *find_tag_name = "scalar";
+
+static void find_tag_select(int force_scalar)
+{
+    if (force_scalar) return;
+#if defined(__SSE2__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        find_tag      = find_tag_sse2;
+        find_tag_name = "sse2";
+    }
+#elif defined(__ARM_NEON)
+#if defined(__aarch64__)
+    if (getauxval(AT_HWCAP) & HWCAP_ASIMD) {
+#else
+    if (getauxval(AT_HWCAP) & HWCAP_NEON) {
+#endif
+        find_tag      = find_tag_neon;
+        find_tag_name = "neon";
     }
-    fwrite(samples, sizeof(short), (size_t)num_samples, p);
-    pclose(p);   /* waits for aplay to finish */
-    free(samples);
-}
 #endif
+}
 
-/* ---- ALSA direct -------------------------------------------------- */
-#if SOUND_MODE == SOUND_MODE_ALSA
+/* ================================================================== */
+/*  Single-pass XML field extractor                                     */
+/*                                                                      */
+/*  Walks the datagram once, looking only at '<' positions, and        */
+/*  records a trimmed slice for the first <tag>value</tag> of every    */
+/*  wanted field.  Same matching rules as xml_get_field(): tag names   */
+/*  are case-insensitive and tags with attributes are not matched.    */
+/* ================================================================== */
+enum xml_field_id {
+    FLD_CALL, FLD_BAND, FLD_MODE,
+    FLD_MULT1, FLD_MULT2, FLD_MULT3,
+    FLD_NEWQSO, FLD_XQSO,
+    FLD_TIMESTAMP, FLD_STATION, FLD_ID,
+    FLD_COUNT
+};
 
-#define SAMPLE_RATE 44100
+static const struct {
+    const char *tag;
+    size_t      len;
+} xml_wanted[FLD_COUNT] = {
+    [FLD_CALL]   = { "call",   4 },
+    [FLD_BAND]   = { "band",   4 },
+    [FLD_MODE]   = { "mode",   4 },
+    [FLD_MULT1]  = { "mult1",  5 },
+    [FLD_MULT2]  = { "mult2",  5 },
+    [FLD_MULT3]  = { "mult3",  5 },
+    [FLD_NEWQSO] = { "newqso", 6 },
+    [FLD_XQSO]   = { "xqso",   4 },
+    [FLD_TIMESTAMP] = { "timestamp",   9 },
+    [FLD_STATION]   = { "stationname", 11 },
+    [FLD_ID]        = { "id",          2 },
+};
 
-static void play_sound(void)
+struct xml_fields {
+    struct xml_slice f[FLD_COUNT];
+    unsigned int     found;          /* bit per enum xml_field_id      */
+};
+
+static int xml_wanted_lookup(const char *name, size_t len)
 {
-    snd_pcm_t *handle;
-    int rc;
+    for (int i = 0; i < FLD_COUNT; i++)
+        if (xml_wanted[i].len == len &&
+            strncasecmp(name, xml_wanted[i].tag, len) == 0)
+            return i;
+    return -1;
+}
 
-    rc = snd_pcm_open(&handle, ALSA_DEVICE, SND_PCM_STREAM_PLAYBACK, 0);
-    if (rc < 0) {
-        fprintf(stderr, "ALSA open error: %s\n", snd_strerror(rc));
-        return;
-    }
+static void xml_scan_fields(const char *xml, size_t len,
+                            struct xml_fields *out)
+{
+    const char  *end = xml + len;
+    const char  *open_at[FLD_COUNT];      /* value start, pending tags */
+    unsigned int pending = 0;
+    const unsigned int all = (1u << FLD_COUNT) - 1;
 
-    snd_pcm_hw_params_t *params;
-    snd_pcm_hw_params_alloca(&params);
-    snd_pcm_hw_params_any(handle, params);
-    snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_RW_INTERLEAVED);
-    snd_pcm_hw_params_set_format(handle, params, SND_PCM_FORMAT_S16_LE);
-    snd_pcm_hw_params_set_channels(handle, params, 1);
+    memset(out, 0, sizeof(*out));
 
-    unsigned int rate = SAMPLE_RATE;
-    snd_pcm_hw_params_set_rate_near(handle, params, &rate, 0);
-    snd_pcm_hw_params(handle, params);
+    const char *p = xml;
+    while (out->found != all &&
+           (p = memchr(p, '<', (size_t)(end - p))) != NULL) {
+        const char *name = ++p;
+        int closing = 0;
+        if (name < end && *name == '/') { closing = 1; name++; }
 
-    int num_samples = (SAMPLE_RATE * BEEP_DURATION) / 1000;
-    short *samples  = malloc((size_t)num_samples * sizeof(short));
-    if (!samples) { perror("malloc"); snd_pcm_close(handle); return; }
+        const char *gt = memchr(name, '>', (size_t)(end - name));
+        if (!gt) break;
+        p = gt + 1;
 
-    for (int i = 0; i < num_samples; i++) {
-        double t     = (double)i / SAMPLE_RATE;
-        double fade  = 1.0;
-        int fadelen  = SAMPLE_RATE / 50;
-        if (i < fadelen)
-            fade = (double)i / fadelen;
-        else if (i > num_samples - fadelen)
-            fade = (double)(num_samples - i) / fadelen;
+        int id = xml_wanted_lookup(name, (size_t)(gt - name));
+        if (id < 0 || (out->found & (1u << id))) continue;
+
+        if (!closing) {
+            if (!(pending & (1u << id))) {
+                open_at[id] = p;
+                pending |= 1u << id;
+            }
+            continue;
+        }
+        if (!(pending & (1u << id))) continue;
 
-        double s  = BEEP_VOLUME * fade * sin(2.0 * M_PI * BEEP_FREQ_HZ * t);
-        samples[i] = (short)(s * 32767.0);
+        /* Value runs from after the open tag to this '</' */
+        const char *vs = open_at[id];
+        const char *ve = name - 2;
+        while (vs < ve && is_xml_space(*vs))     vs++;
+        while (ve > vs && is_xml_space(ve[-1])) ve--;
+        out->f[id].p   = vs;
+        out->f[id].len = (size_t)(ve - vs);
+        out->found    |= 1u << id;
     }
+}
 
-    snd_pcm_writei(handle, samples, (snd_pcm_uframes_t)num_samples);
-    snd_pcm_drain(handle);
-    snd_pcm_close(handle);
-    free(samples);
+/* Case-insensitive comparison of a slice with a C string. */
+static int xml_slice_eq(const struct xml_slice *s, const char *str)
+{
+    size_t n = strlen(str);
+    return s->len == n && strncasecmp(s->p, str, n) == 0;
 }
-#endif
 
 /* ================================================================== */
-/*  Timestamp helper                                                     */
+/*  Latency histograms                                                  */
+/*                                                                      */
+/*  Log-linear buckets: exact below 16 ns, then 16 linear sub-buckets */
+/*  per power of two (at most 6.25 % error), covering all of uint64  */
+/*  in a fixed 7.8 KiB per histogram.  Each histogram has a single    */
+/*  writer; relaxed atomics let SIGUSR1 dump it from another thread.  */
+/*  All stage timestamps are CLOCK_REALTIME because that is what the  */
+/*  kernel's SO_TIMESTAMPNS receive stamp uses.                        */
 /* ================================================================== */
-static void print_timestamp(void)
+#define HIST_SUB_BITS  4
+#define HIST_SUB       (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS   ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct lat_hist {
+    const char   *name;
+    atomic_ullong count;
+    atomic_ullong max_ns;
+    atomic_ullong bucket[HIST_BUCKETS];
+};
+
+enum lat_stage {
+    LAT_RX_PARSED,        /* kernel receive stamp -> fields extracted  */
+    LAT_PARSED_TRIGGER,   /* fields extracted -> bell queued, no dups  */
+    LAT_TRIGGER_SAMPLE,   /* bell decided -> first sample queued       */
+    LAT_RX_SAMPLE,        /* kernel receive stamp -> first sample      */
+    LAT_COUNT
+};
+
+static struct lat_hist g_lat[LAT_COUNT] = {
+    [LAT_RX_PARSED]      = { .name = "rx -> parsed"         },
+    [LAT_PARSED_TRIGGER] = { .name = "parsed -> trigger"    },
+    [LAT_TRIGGER_SAMPLE] = { .name = "trigger -> sample"    },
+    [LAT_RX_SAMPLE]      = { .name = "rx -> sample (total)" },
+};
+
+static uint64_t ts_ns(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000ull + (uint64_t)ts->tv_nsec;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts_ns(&ts);
+}
+
+static unsigned int hist_index(uint64_t v)
+{
+    if (v < HIST_SUB) return (unsigned int)v;
+    unsigned int shift = 63u - (unsigned int)__builtin_clzll(v) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB + (unsigned int)((v >> shift) & (HIST_SUB - 1));
+}
+
+/* Record end - start; clock steps backwards count as zero. */
+static void lat_record(enum lat_stage st, uint64_t start, uint64_t end)
+{
+    struct lat_hist *h = &g_lat[st];
+    uint64_t v = end > start ? end - start : 0;
+    atomic_fetch_add_explicit(&h->bucket[hist_index(v)], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    if (v > atomic_load_explicit(&h->max_ns, memory_order_relaxed))
+        atomic_store_explicit(&h->max_ns, v, memory_order_relaxed);
+}
+
+#ifndef LISTENER_NO_MAIN
+/* Largest value that lands in bucket i */
+static uint64_t hist_bucket_high(unsigned int i)
+{
+    if (i < HIST_SUB) return i;
+    unsigned int shift = i / HIST_SUB - 1;
+    uint64_t     low   = (uint64_t)(HIST_SUB + i % HIST_SUB) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+static void lat_dump(FILE *f)
 {
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    char buf[32];
-    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", t);
-    printf("[%s] ", buf);
+    static const double pct[] = { 50.0, 90.0, 99.0, 99.9 };
+
+    fprintf(f, "Latency (us)            count      p50      p90      p99"
+               "    p99.9      max\n");
+    for (int s = 0; s < LAT_COUNT; s++) {
+        struct lat_hist *h = &g_lat[s];
+        unsigned long long n = atomic_load_explicit(&h->count,
+                                                    memory_order_relaxed);
+        fprintf(f, "  %-20s %8llu", h->name, n);
+        if (n == 0) { fprintf(f, "\n"); continue; }
+
+        uint64_t max = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+        unsigned long long seen = 0;
+        unsigned int       i    = 0;
+        for (size_t p = 0; p < sizeof(pct) / sizeof(pct[0]); p++) {
+            unsigned long long want =
+                (unsigned long long)((double)n * pct[p] / 100.0 + 0.5);
+            if (want == 0) want = 1;
+            while (i < HIST_BUCKETS && seen < want)
+                seen += atomic_load_explicit(&h->bucket[i++],
+                                             memory_order_relaxed);
+            uint64_t v = hist_bucket_high(i ? i - 1 : 0);
+            fprintf(f, " %8.1f", (double)(v < max ? v : max) / 1e3);
+        }
+        fprintf(f, " %8.1f\n", (double)max / 1e3);
+    }
+    fflush(f);
 }
+#endif /* LISTENER_NO_MAIN */
 
+#ifndef LISTENER_NO_MAIN
 /* ================================================================== */
-/*  Process one UDP datagram                                            */
+/*  Configuration file                                                  */
+/*                                                                      */
+/*  One "key = value" per line, '#' starts a comment:                 */
+/*    port          = 12060                                            */
+/*    listen        = 0.0.0.0:12060 [::]:12060 10.0.1.5:12061@eth1    */
+/*    sound         = wav | tone                                       */
+/*    wav_file      = ./handbell.wav                                   */
+/*    beep_freq     = 880          (Hz)                                */
+/*    beep_duration = 400          (ms)                                */
+/*    beep_volume   = 0.6          (0.0 – 1.0)                         */
+/*    device        = default      (ALSA device, or aplay -D)          */
+/*    coalesce_ms   = 400                                              */
+/*    strikes       = 3                                                */
+/*    bells_per_min = 20                                               */
+/*    backend       = auto | alsa | aplay | fork   (startup only)      */
+/*    trigger       = dxlog | local                                    */
+/*    mult1_sound   = bell | tone FREQ [MS] | file.wav   (also 2, 3)   */
+/*    rcvbuf        = 0            (bytes, 0 = kernel default)         */
+/*    stats_interval = 60          (s, 0 = off)                        */
+/*    workers       = 0            (receive threads, startup only)     */
+/*    receive       = recvmmsg | io_uring          (startup only)      */
+/*    filter        = off | on                     (startup only)      */
+/*    allow         = 192.168.1.0/24 10.0.0.7 fd00::/8   (with filter) */
+/*    max_length    = 0            (bytes, with filter, 0 = no limit)  */
+/*  Keys left out keep their built-in default.  -c, -m, -R and -F on  */
+/*  the command line win over the file, also after a reload.          */
+/*                                                                      */
+/*  'listen' lists up to LISTEN_MAX sockets as ADDR:PORT (IPv6 in     */
+/*  brackets), optionally @interface to take only what arrives there; */
+/*  a bare PORT is 0.0.0.0:PORT.  Without it, 'port' is listened to   */
+/*  on all IPv4 addresses.                                             */
 /* ================================================================== */
-static void process_datagram(const char *buf, size_t len,
-                              const struct sockaddr_in *src)
+static int parse_uint(const char *v, unsigned long lo, unsigned long hi,
+                      unsigned int *out)
 {
-    /* Ignore datagrams that do not contain <contactinfo> (case-insensitive) */
-    int found_ci = 0;
-    for (size_t i = 0; i + 13 <= len; i++) {
-        if (strncasecmp(buf + i, "<contactinfo>", 13) == 0) {
-            found_ci = 1;
-            break;
-        }
+    char *end;
+    errno = 0;
+    unsigned long n = strtoul(v, &end, 10);
+    if (errno || end == v || *end || *v == '-' || n < lo || n > hi)
+        return -1;
+    *out = (unsigned int)n;
+    return 0;
+}
+
+struct endpoint {
+    struct sockaddr_storage addr;    /* zero-filled beyond the address */
+    socklen_t               addrlen;
+    char                    ifname[IFNAMSIZ];   /* "" = any            */
+};
+
+struct listen_set {
+    int             n;
+    struct endpoint ep[LISTEN_MAX];
+};
+
+/* "PORT", "A.B.C.D:PORT" or "[V6]:PORT", each optionally "@ifname" */
+static int endpoint_parse(const char *text, struct endpoint *ep)
+{
+    char buf[96];
+    if (strlen(text) >= sizeof(buf)) return -1;
+    strcpy(buf, text);
+    memset(ep, 0, sizeof(*ep));
+
+    char *at = strchr(buf, '@');
+    if (at) {
+        *at++ = '\0';
+        if (!*at || strlen(at) >= sizeof(ep->ifname)) return -1;
+        strcpy(ep->ifname, at);
     }
-    if (!found_ci) return;
-/*    printf("buf=");
-    for (int i = 0; i <= len; i++)
-      printf("%c", *(buf + i));
-    printf("\n"); */
 
+    char *host = NULL, *port = buf;
+    if (buf[0] == '[') {
+        char *close = strchr(buf, ']');
+        if (!close || close[1] != ':') return -1;
+        *close = '\0';
+        host = buf + 1;
+        port = close + 2;
+    } else if ((port = strrchr(buf, ':')) != NULL) {
+        *port++ = '\0';
+        host = buf;
+    } else {
+        port = buf;
+    }
 
-    /* NUL-terminate */
-    char *xml = malloc(len + 1);
-    if (!xml) { perror("malloc"); return; }
-    memcpy(xml, buf, len);
-    xml[len] = '\0';
+    unsigned int p;
+    if (parse_uint(port, 1, 65535, &p) < 0) return -1;
 
-    char call[64]  = "";
-    char band[32]  = "";
-    char mode[16]  = "";
-    char mult1[64] = "";
-    char mult2[64] = "";
-    char mult3[64] = "";
+    if (host && strchr(host, ':')) {
+        struct sockaddr_in6 *a = (struct sockaddr_in6 *)&ep->addr;
+        a->sin6_family = AF_INET6;
+        a->sin6_port   = htons((uint16_t)p);
+        if (inet_pton(AF_INET6, host, &a->sin6_addr) != 1) return -1;
+        ep->addrlen = sizeof(*a);
+    } else {
+        struct sockaddr_in *a = (struct sockaddr_in *)&ep->addr;
+        a->sin_family      = AF_INET;
+        a->sin_port        = htons((uint16_t)p);
+        a->sin_addr.s_addr = htonl(INADDR_ANY);
+        if (host && inet_pton(AF_INET, host, &a->sin_addr) != 1) return -1;
+        ep->addrlen = sizeof(*a);
+    }
+    return 0;
+}
 
-    char newqso[16] = "";
-    char xqso[16]   = "";
+static const char *endpoint_str(const struct endpoint *ep, char *buf,
+                                size_t size)
+{
+    char host[INET6_ADDRSTRLEN];
+    unsigned int port;
+    if (ep->addr.ss_family == AF_INET6) {
+        const struct sockaddr_in6 *a = (const struct sockaddr_in6 *)&ep->addr;
+        inet_ntop(AF_INET6, &a->sin6_addr, host, sizeof(host));
+        port = ntohs(a->sin6_port);
+        snprintf(buf, size, "[%s]:%u", host, port);
+    } else {
+        const struct sockaddr_in *a = (const struct sockaddr_in *)&ep->addr;
+        inet_ntop(AF_INET, &a->sin_addr, host, sizeof(host));
+        port = ntohs(a->sin_port);
+        snprintf(buf, size, "%s:%u", host, port);
+    }
+    if (ep->ifname[0]) {
+        size_t n = strlen(buf);
+        snprintf(buf + n, size - n, "@%s", ep->ifname);
+    }
+    return buf;
+}
 
-    xml_get_field(xml, "call",   call,   sizeof(call));
-    xml_get_field(xml, "band",   band,   sizeof(band));
-    xml_get_field(xml, "mode",   mode,   sizeof(mode));
-    xml_get_field(xml, "mult1",  mult1,  sizeof(mult1));
-    xml_get_field(xml, "mult2",  mult2,  sizeof(mult2));
-    xml_get_field(xml, "mult3",  mult3,  sizeof(mult3));
-    xml_get_field(xml, "newqso", newqso, sizeof(newqso));
-    xml_get_field(xml, "xqso",   xqso,   sizeof(xqso));
+static int endpoint_eq(const struct endpoint *a, const struct endpoint *b)
+{
+    return a->addrlen == b->addrlen &&
+           memcmp(&a->addr, &b->addr, a->addrlen) == 0 &&
+           strcmp(a->ifname, b->ifname) == 0;
+}
 
-    /* ---- Trigger: all three conditions must be true ---------------- */
-    int has_mult = (mult1[0] != '\0') ||
-                   (mult2[0] != '\0') ||
-                   (mult3[0] != '\0');
-    int is_new   = (strcasecmp(newqso, "true")  == 0);
-
-    print_timestamp();
-    printf("PKT from %-15s call=%-8s band=%-3s mode=%-3s mult1=%-2s  mult2=%-2s  mult3=%-2s newqso=%-5s",
-           inet_ntoa(src->sin_addr),
-           call[0]   ? call   : "-",
-           band[0]   ? band   : "-",
-           mode[0]   ? mode   : "-",
-           mult1[0]  ? mult1  : "-",
-           mult2[0]  ? mult2  : "-",
-           mult3[0]  ? mult3  : "-",
-           newqso[0] ? newqso : "-");
-
-    if (has_mult && is_new) {
-        printf("  *** MULT → SOUND ***");
-        fflush(stdout);
-        play_sound();
+/* Can broadcasts or multicasts reach 'ep'?  True of the any address,
+   a group address and an interface's broadcast address. */
+static int endpoint_takes_groups(const struct endpoint *ep)
+{
+    if (ep->addr.ss_family == AF_INET6) {
+        const struct in6_addr *a =
+            &((const struct sockaddr_in6 *)&ep->addr)->sin6_addr;
+        return IN6_IS_ADDR_UNSPECIFIED(a) || IN6_IS_ADDR_MULTICAST(a);
     }
-    printf("\n");
-    fflush(stdout);
+    in_addr_t a = ((const struct sockaddr_in *)&ep->addr)->sin_addr.s_addr;
+    if (a == htonl(INADDR_ANY) || a == htonl(INADDR_BROADCAST) ||
+        IN_MULTICAST(ntohl(a)))
+        return 1;
 
-    free(xml);
+    struct ifaddrs *ifs, *i;
+    int             bcast = 0;
+    if (getifaddrs(&ifs) < 0) return 0;
+    for (i = ifs; i && !bcast; i = i->ifa_next)
+        bcast = (i->ifa_flags & IFF_BROADCAST) && i->ifa_broadaddr &&
+                i->ifa_broadaddr->sa_family == AF_INET &&
+                ((struct sockaddr_in *)i->ifa_broadaddr)->sin_addr.s_addr == a;
+    freeifaddrs(ifs);
+    return bcast;
 }
 
-/* ================================================================== */
-/*  Main                                                                 */
-/* ================================================================== */
-int main(void)
+static int listen_set_eq(const struct listen_set *a,
+                         const struct listen_set *b)
 {
-    const char *mode_name =
-#if   SOUND_MODE == SOUND_MODE_WAV
-        "WAV file via aplay (" WAV_FILE ")";
-#elif SOUND_MODE == SOUND_MODE_BEEP
-        "synthesised tone via aplay (no file needed)";
-#else
-        "synthesised tone via ALSA direct";
-#endif
+    if (a->n != b->n) return 0;
+    for (int i = 0; i < a->n; i++)
+        if (!endpoint_eq(&a->ep[i], &b->ep[i])) return 0;
+    return 1;
+}
 
-    printf("=== DXLog Multiplier Listener ===\n");
-    printf("Port      : UDP %d\n", LISTEN_PORT);
-    printf("Trigger   : mult1/mult2/mult3 non-empty AND newqso=true\n");
-    printf("Sound     : %s\n", mode_name);
-#if SOUND_MODE == SOUND_MODE_BEEP || SOUND_MODE == SOUND_MODE_ALSA
-    printf("Tone      : %d Hz, %d ms, volume %.0f%%\n",
-           BEEP_FREQ_HZ, BEEP_DURATION, BEEP_VOLUME * 100.0);
-#endif
-    printf("\n");
-    fflush(stdout);
+/* Whitespace- or comma-separated endpoints; duplicates are dropped */
+static int listen_set_parse(const char *text, struct listen_set *ls)
+{
+    char buf[512], *save = NULL;
+    if (strlen(text) >= sizeof(buf)) return -1;
+    strcpy(buf, text);
+    ls->n = 0;
+    for (char *tok = strtok_r(buf, " \t,", &save); tok;
+         tok = strtok_r(NULL, " \t,", &save)) {
+        struct endpoint ep;
+        if (ls->n == LISTEN_MAX || endpoint_parse(tok, &ep) < 0) return -1;
+        int dup = 0;
+        for (int i = 0; i < ls->n; i++)
+            dup |= endpoint_eq(&ls->ep[i], &ep);
+        if (!dup) ls->ep[ls->n++] = ep;
+    }
+    return ls->n ? 0 : -1;
+}
 
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) { perror("socket"); return 1; }
+/* 'allow' networks for the socket filter */
+#define ALLOW_MAX  16
 
-    int yes = 1;
-    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+struct allow_net {
+    int           family;            /* AF_INET or AF_INET6             */
+    unsigned char addr[16];
+    unsigned int  prefix;            /* bits                            */
+};
 
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family      = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port        = htons(LISTEN_PORT);
+struct allow_list {
+    int              n;
+    struct allow_net net[ALLOW_MAX];
+};
 
-    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        perror("bind");
-        close(sock);
-        return 1;
+/* ADDR or ADDR/BITS, IPv4 or IPv6 */
+static int allow_net_parse(const char *text, struct allow_net *a)
+{
+    char buf[64];
+    if (strlen(text) >= sizeof(buf)) return -1;
+    strcpy(buf, text);
+    memset(a, 0, sizeof(*a));
+
+    char *slash = strchr(buf, '/');
+    if (slash) *slash++ = '\0';
+    a->family = strchr(buf, ':') ? AF_INET6 : AF_INET;
+    if (inet_pton(a->family, buf, a->addr) != 1) return -1;
+    unsigned int max = a->family == AF_INET ? 32 : 128;
+    a->prefix = max;
+    if (slash && parse_uint(slash, 0, max, &a->prefix) < 0) return -1;
+    return 0;
+}
+
+static int allow_list_parse(const char *text, struct allow_list *al)
+{
+    char buf[1024], *save = NULL;
+    if (strlen(text) >= sizeof(buf)) return -1;
+    strcpy(buf, text);
+    al->n = 0;
+    for (char *tok = strtok_r(buf, " \t,", &save); tok;
+         tok = strtok_r(NULL, " \t,", &save))
+        if (al->n == ALLOW_MAX || allow_net_parse(tok, &al->net[al->n++]) < 0)
+            return -1;
+    return al->n ? 0 : -1;
+}
+
+static const char *allow_net_str(const struct allow_net *a, char *buf,
+                                 size_t size)
+{
+    char host[INET6_ADDRSTRLEN];
+    inet_ntop(a->family, a->addr, host, sizeof(host));
+    snprintf(buf, size, "%s/%u", host, a->prefix);
+    return buf;
+}
+
+struct config {
+    int          port;
+    struct listen_set listen;        /* n = 0: 0.0.0.0:port            */
+    int          tone;               /* 1 = synthesised tone, 0 = WAV  */
+    char         wav_file[256];
+    unsigned int beep_freq;          /* Hz                              */
+    unsigned int beep_ms;
+    double       beep_volume;        /* 0.0 – 1.0                       */
+    char         device[64];
+    unsigned int coalesce_ms;
+    unsigned int strikes;
+    unsigned int bells_per_min;
+    char         backend[8];         /* auto or a backend name; read
+                                        at startup only               */
+    int          trigger_local;      /* 1 = own mult index decides     */
+    char         mult_sound[3][256]; /* per mult slot, "" = the bell   */
+    unsigned int rcvbuf;             /* SO_RCVBUF bytes, 0 = default   */
+    unsigned int stats_interval;     /* s, 0 = no periodic report      */
+    unsigned int workers;            /* receive threads, read at
+                                        startup only                  */
+    int          recv_uring;         /* 1 = io_uring; startup only     */
+    int          filter;             /* 1 = BPF socket filter; these   */
+    struct allow_list allow;         /* three are read at startup      */
+    unsigned int max_length;         /* only; 0 = no upper bound       */
+};
+
+/* Command-line overrides, -1 / NULL when not given */
+static long g_opt_coalesce = -1, g_opt_strikes = -1, g_opt_bells = -1;
+static long g_opt_workers = -1, g_opt_uring = -1;
+static const char *g_opt_backend;
+
+static void config_defaults(struct config *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->port          = LISTEN_PORT;
+    c->tone          = SOUND_MODE != SOUND_MODE_WAV;
+    snprintf(c->wav_file, sizeof(c->wav_file), "%s", WAV_FILE);
+    c->beep_freq     = BEEP_FREQ_HZ;
+    c->beep_ms       = BEEP_DURATION;
+    c->beep_volume   = BEEP_VOLUME;
+    snprintf(c->device, sizeof(c->device), "%s", ALSA_DEVICE);
+    c->coalesce_ms   = COALESCE_MS;
+    c->strikes       = MULTI_RING_MAX;
+    c->bells_per_min = BELLS_PER_MIN;
+    c->rcvbuf        = RECV_BUFFER;
+    c->stats_interval = STATS_INTERVAL_S;
+    c->workers       = RECV_WORKERS;
+    snprintf(c->backend, sizeof(c->backend), "%s",
+             SOUND_MODE == SOUND_MODE_ALSA ? "alsa" : "auto");
+}
+
+/* A per-slot sound: "tone FREQ [MS]" returns 1 with the values (MS
+   defaults to 'ms'), anything else 0 (a WAV file), a malformed tone -1. */
+static int sound_spec_tone(const char *spec, unsigned int *freq,
+                           unsigned int *ms)
+{
+    if (strncmp(spec, "tone", 4) != 0 || (spec[4] && !is_xml_space(spec[4])))
+        return 0;
+    char *end;
+    unsigned long f = strtoul(spec + 4, &end, 10);
+    unsigned long m = *ms;
+    if (end == spec + 4) return -1;
+    while (is_xml_space(*end)) end++;
+    if (*end) {
+        const char *p = end;
+        m = strtoul(p, &end, 10);
+        if (end == p || *end) return -1;
     }
+    if (f < 20 || f > 20000 || m < 10 || m > 10000) return -1;
+    *freq = (unsigned int)f;
+    *ms   = (unsigned int)m;
+    return 1;
+}
 
-    printf("Listening on 0.0.0.0:%d …\n\n", LISTEN_PORT);
-    fflush(stdout);
+static int config_set(struct config *c, const char *key, const char *val)
+{
+    unsigned int u;
 
-    static char buf[65536];
-    for (;;) {
-        struct sockaddr_in src;
-        socklen_t srclen = sizeof(src);
-        ssize_t n = recvfrom(sock, buf, sizeof(buf) - 1, 0,
-                             (struct sockaddr *)&src, &srclen);
-        if (n < 0) { perror("recvfrom"); continue; }
-        process_datagram(buf, (size_t)n, &src);
+    if (strcmp(key, "port") == 0) {
+        if (parse_uint(val, 1, 65535, &u) < 0) return -1;
+        c->port = (int)u;
+    } else if (strcmp(key, "sound") == 0) {
+        if      (strcmp(val, "wav") == 0)  c->tone = 0;
+        else if (strcmp(val, "tone") == 0 ||
+                 strcmp(val, "beep") == 0) c->tone = 1;
+        else return -1;
+    } else if (strcmp(key, "wav_file") == 0) {
+        if (!*val || strlen(val) >= sizeof(c->wav_file)) return -1;
+        strcpy(c->wav_file, val);
+    } else if (strcmp(key, "beep_freq") == 0) {
+        return parse_uint(val, 20, 20000, &c->beep_freq);
+    } else if (strcmp(key, "beep_duration") == 0) {
+        return parse_uint(val, 10, 10000, &c->beep_ms);
+    } else if (strcmp(key, "beep_volume") == 0) {
+        char *end;
+        double v = strtod(val, &end);
+        if (end == val || *end || !(v >= 0.0 && v <= 1.0)) return -1;
+        c->beep_volume = v;
+    } else if (strcmp(key, "device") == 0) {
+        if (!*val || strlen(val) >= sizeof(c->device)) return -1;
+        strcpy(c->device, val);
+    } else if (strcmp(key, "coalesce_ms") == 0) {
+        return parse_uint(val, 0, 60000, &c->coalesce_ms);
+    } else if (strcmp(key, "strikes") == 0) {
+        return parse_uint(val, 1, MIX_VOICES, &c->strikes);
+    } else if (strcmp(key, "bells_per_min") == 0) {
+        return parse_uint(val, 0, 6000, &c->bells_per_min);
+    } else if (strcmp(key, "listen") == 0) {
+        return listen_set_parse(val, &c->listen);
+    } else if (strcmp(key, "rcvbuf") == 0) {
+        return parse_uint(val, 0, 1u << 30, &c->rcvbuf);
+    } else if (strcmp(key, "stats_interval") == 0) {
+        return parse_uint(val, 0, 86400, &c->stats_interval);
+    } else if (strcmp(key, "filter") == 0) {
+        if      (strcmp(val, "off") == 0) c->filter = 0;
+        else if (strcmp(val, "on")  == 0) c->filter = 1;
+        else return -1;
+    } else if (strcmp(key, "allow") == 0) {
+        return allow_list_parse(val, &c->allow);
+    } else if (strcmp(key, "max_length") == 0) {
+        return parse_uint(val, 0, RECV_SLOT_SIZE - 1, &c->max_length);
+    } else if (strcmp(key, "receive") == 0) {
+        if      (strcmp(val, "recvmmsg") == 0) c->recv_uring = 0;
+        else if (strcmp(val, "io_uring") == 0) c->recv_uring = 1;
+        else return -1;
+    } else if (strcmp(key, "workers") == 0) {
+        return parse_uint(val, 0, WORKER_MAX, &c->workers);
+    } else if (strcmp(key, "backend") == 0) {
+        if (strcmp(val, "auto") != 0 && strcmp(val, "aplay") != 0 &&
+            strcmp(val, "alsa") != 0 && strcmp(val, "fork") != 0)
+            return -1;
+        snprintf(c->backend, sizeof(c->backend), "%s", val);
+    } else if (strcmp(key, "trigger") == 0) {
+        if      (strcmp(val, "dxlog") == 0) c->trigger_local = 0;
+        else if (strcmp(val, "local") == 0) c->trigger_local = 1;
+        else return -1;
+    } else if (strncmp(key, "mult", 4) == 0 && key[4] >= '1' &&
+               key[4] <= '3' && strcmp(key + 5, "_sound") == 0) {
+        char *dst = c->mult_sound[key[4] - '1'];
+        unsigned int f, ms = c->beep_ms;
+        if (strcmp(val, "bell") == 0) val = "";
+        else if (!*val || sound_spec_tone(val, &f, &ms) < 0) return -1;
+        if (strlen(val) >= sizeof(c->mult_sound[0])) return -1;
+        strcpy(dst, val);
+    } else {
+        return -2;
+    }
+    return 0;
+}
+
+static char *trim(char *p)
+{
+    while (is_xml_space(*p)) p++;
+    char *e = p + strlen(p);
+    while (e > p && is_xml_space(e[-1])) e--;
+    *e = '\0';
+    return p;
+}
+
+/* Fill 'c' from the defaults, the file and the command line.  A
+   missing file is only an error if 'must_exist'.  On error 'c' is
+   left unspecified. */
+static int config_load(const char *path, struct config *c, int must_exist)
+{
+    config_defaults(c);
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        if (errno != ENOENT || must_exist) { perror(path); return -1; }
+    } else {
+        char line[512];
+        int  lineno = 0, rc = 0;
+        while (fgets(line, sizeof(line), f)) {
+            lineno++;
+            char *hash = strchr(line, '#');
+            if (hash) *hash = '\0';
+            char *key = trim(line);
+            if (!*key) continue;
+            char *eq = strchr(key, '=');
+            if (!eq) {
+                fprintf(stderr, "%s:%d: expected key = value\n", path, lineno);
+                rc = -1;
+                continue;
+            }
+            *eq = '\0';
+            key = trim(key);
+            char *val = trim(eq + 1);
+            int r = config_set(c, key, val);
+            if (r == -2)
+                fprintf(stderr, "%s:%d: unknown key '%s'\n", path, lineno, key);
+            else if (r < 0)
+                fprintf(stderr, "%s:%d: bad value '%s' for %s\n",
+                        path, lineno, val, key);
+            if (r < 0) rc = -1;
+        }
+        fclose(f);
+        if (rc < 0) return -1;
+    }
+
+    if (c->listen.n == 0) {
+        char text[8];
+        snprintf(text, sizeof(text), "%d", c->port);
+        listen_set_parse(text, &c->listen);
+    }
+
+    /* The filter would drop everything on a socket whose family has
+       no 'allow' network; refuse rather than go deaf */
+    for (int i = 0; c->filter && c->allow.n && i < c->listen.n; i++) {
+        int family = c->listen.ep[i].addr.ss_family, r = 0;
+        while (r < c->allow.n && c->allow.net[r].family != family) r++;
+        if (r == c->allow.n) {
+            char name[96];
+            fprintf(stderr, "%s: allow has no %s network for %s\n", path,
+                    family == AF_INET6 ? "IPv6" : "IPv4",
+                    endpoint_str(&c->listen.ep[i], name, sizeof(name)));
+            return -1;
+        }
+    }
+
+    if (g_opt_coalesce >= 0) c->coalesce_ms   = (unsigned int)g_opt_coalesce;
+    if (g_opt_strikes  >= 0) c->strikes       = (unsigned int)g_opt_strikes;
+    if (g_opt_bells    >= 0) c->bells_per_min = (unsigned int)g_opt_bells;
+    if (g_opt_backend)
+        snprintf(c->backend, sizeof(c->backend), "%s", g_opt_backend);
+    if (g_opt_workers  >= 0) c->workers       = (unsigned int)g_opt_workers;
+    if (g_opt_uring    >= 0) c->recv_uring    = (int)g_opt_uring;
+    return 0;
+}
+
+/* Does switching from 'a' to 'b' need a new sound? */
+static int config_sound_changed(const struct config *a, const struct config *b)
+{
+    int tones = b->tone;
+    for (int i = 0; i < 3; i++) {
+        if (strcmp(a->mult_sound[i], b->mult_sound[i]) != 0) return 1;
+        if (strncmp(b->mult_sound[i], "tone", 4) == 0) tones = 1;
+    }
+    return a->tone != b->tone ||
+           strcmp(a->device, b->device) != 0 ||
+           (!b->tone && strcmp(a->wav_file, b->wav_file) != 0) ||
+           (tones && (a->beep_freq != b->beep_freq ||
+                      a->beep_ms != b->beep_ms ||
+                      a->beep_volume != b->beep_volume));
+}
+#endif /* LISTENER_NO_MAIN */
+
+/* ================================================================== */
+/*  Sounds                                                              */
+/*                                                                      */
+/*  Whatever the mode, the bell is decoded or synthesised once (at    */
+/*  startup, and again on a config change) into signed 16-bit mono    */
+/*  PCM and mixed from memory.                                         */
+/* ================================================================== */
+struct trigger_event {
+    uint64_t rx_ns;              /* kernel receive stamp (REALTIME)    */
+    uint64_t trigger_ns;         /* bell decided (REALTIME)            */
+    unsigned mults;              /* mult slots behind it, bit 0 = mult1 */
+};
+
+#ifndef LISTENER_NO_MAIN
+/* Audio thread: the first samples of a bell have been queued */
+static void lat_first_sample(const struct trigger_event *ev)
+{
+    uint64_t now = now_ns();
+    lat_record(LAT_TRIGGER_SAMPLE, ev->trigger_ns, now);
+    lat_record(LAT_RX_SAMPLE,      ev->rx_ns,      now);
+}
+
+struct sound {
+    const int16_t *pcm;          /* mono S16, native endian            */
+    size_t         frames;
+    unsigned int   rate;
+    int16_t       *owned;        /* heap copy to free, if any          */
+    void          *map;          /* file mapping pcm points into, if any */
+    size_t         map_len;
+};
+
+static void sound_free(struct sound *snd)
+{
+    free(snd->owned);
+    if (snd->map) munmap(snd->map, snd->map_len);
+    memset(snd, 0, sizeof(*snd));
+}
+
+/* ---- Tone synthesis ----------------------------------------------- */
+static int tone_render(unsigned int freq, unsigned int ms, double volume,
+                       unsigned int rate, struct sound *snd)
+{
+    int num_samples = (int)(((unsigned long)rate * ms) / 1000);
+    int16_t *samples = malloc((size_t)num_samples * sizeof(int16_t));
+    if (!samples) { perror("malloc"); return -1; }
+
+    for (int i = 0; i < num_samples; i++) {
+        /* Sine wave with a short linear fade-in/out to avoid clicks */
+        double t      = (double)i / rate;
+        double fade   = 1.0;
+        int    fadelen = (int)rate / 50;     /* 20 ms */
+        if (i < fadelen)
+            fade = (double)i / fadelen;
+        else if (i > num_samples - fadelen)
+            fade = (double)(num_samples - i) / fadelen;
+
+        double s  = volume * fade * sin(2.0 * M_PI * freq * t);
+        samples[i] = (int16_t)(s * 32767.0);
     }
 
-    close(sock);
+    sound_free(snd);
+    snd->pcm    = samples;
+    snd->owned  = samples;
+    snd->frames = (size_t)num_samples;
+    snd->rate   = rate;
     return 0;
 }
+
+/* ---- WAV file ----------------------------------------------------- */
+/*
+ * The file is mapped and parsed once per (re)load.  A 16-bit mono file
+ * is played straight from the mapping; anything else is converted to
+ * 16-bit mono once and the mapping dropped.
+ */
+
+static uint32_t rd_le32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t rd_le16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+/* One little-endian sample of 8/16/24/32 bits as signed 16-bit */
+static int wav_sample_s16(const unsigned char *p, unsigned int bits)
+{
+    switch (bits) {
+    case 8:  return (p[0] - 128) * 256;
+    case 16: return (int16_t)rd_le16(p);
+    default: return (int16_t)rd_le16(p + bits / 8 - 2);  /* top bits */
+    }
+}
+
+/* Map a RIFF/WAVE file and locate its fmt and data chunks.  Accepts
+   integer PCM (plain or WAVE_FORMAT_EXTENSIBLE), 8/16/24/32 bit. */
+static int wav_load(const char *path, struct sound *snd)
+{
+    memset(snd, 0, sizeof(*snd));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { perror(path); return -1; }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < 12) {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        close(fd);
+        return -1;
+    }
+    size_t map_len = (size_t)st.st_size;
+    void  *map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { perror("mmap"); return -1; }
+
+    const unsigned char *p   = map;
+    const unsigned char *end = p + map_len;
+    const unsigned char *data = NULL;
+    size_t       data_len = 0;
+    unsigned int channels = 0, rate = 0, block_align = 0, bits = 0;
+
+    if (memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "%s: not a RIFF/WAVE file\n", path);
+        goto fail;
+    }
+
+    for (p += 12; end - p >= 8; ) {
+        uint32_t    size = rd_le32(p + 4);
+        const unsigned char *body = p + 8;
+        if (size > (size_t)(end - body)) size = (uint32_t)(end - body);
+
+        if (memcmp(p, "fmt ", 4) == 0 && size >= 16) {
+            unsigned int tag = rd_le16(body);
+            if (tag == 0xFFFE && size >= 26)        /* extensible */
+                tag = rd_le16(body + 24);           /* sub-format */
+            if (tag != 1) {
+                fprintf(stderr, "%s: not integer PCM (format %u)\n",
+                        path, tag);
+                goto fail;
+            }
+            channels    = rd_le16(body + 2);
+            rate        = rd_le32(body + 4);
+            block_align = rd_le16(body + 12);
+            bits        = rd_le16(body + 14);
+        } else if (memcmp(p, "data", 4) == 0) {
+            data     = body;
+            data_len = size;
+        }
+        p = body + size + (size & 1);               /* pad byte */
+    }
+
+    if (!data || !channels || !rate ||
+        (bits != 8 && bits != 16 && bits != 24 && bits != 32) ||
+        block_align != channels * bits / 8) {
+        fprintf(stderr, "%s: missing or unsupported fmt/data chunk\n", path);
+        goto fail;
+    }
+    if (data_len < block_align) {               /* nothing to play */
+        fprintf(stderr, "%s: empty data chunk\n", path);
+        goto fail;
+    }
+
+    snd->frames = data_len / block_align;
+    snd->rate   = rate;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (channels == 1 && bits == 16 && ((uintptr_t)data & 1) == 0) {
+        snd->pcm     = (const int16_t *)data;       /* zero copy */
+        snd->map     = map;
+        snd->map_len = map_len;
+        return 0;
+    }
+#endif
+
+    snd->owned = malloc(snd->frames * sizeof(int16_t));
+    if (!snd->owned) { perror("malloc"); goto fail; }
+    for (size_t i = 0; i < snd->frames; i++) {
+        const unsigned char *f = data + i * block_align;
+        int sum = 0;
+        for (unsigned int c = 0; c < channels; c++)
+            sum += wav_sample_s16(f + c * bits / 8, bits);
+        snd->owned[i] = (int16_t)(sum / (int)channels);
+    }
+    snd->pcm = snd->owned;
+    munmap(map, map_len);
+    return 0;
+
+fail:
+    munmap(map, map_len);
+    memset(snd, 0, sizeof(*snd));
+    return -1;
+}
+
+/* Convert 'snd' to 'rate' by linear interpolation, so that every
+   sound in a bank can share one output stream. */
+static int sound_resample(struct sound *snd, unsigned int rate)
+{
+    if (snd->rate == rate || snd->frames == 0) return 0;
+
+    size_t   frames = (size_t)((double)snd->frames * rate / snd->rate);
+    if (frames == 0) frames = 1;             /* a click, never silence */
+    int16_t *out    = malloc(frames * sizeof(int16_t));
+    if (!out) { perror("malloc"); return -1; }
+    double step = (double)snd->rate / rate;
+    for (size_t i = 0; i < frames; i++) {
+        double pos  = (double)i * step;
+        size_t j    = (size_t)pos;
+        double frac = pos - (double)j;
+        int    a    = snd->pcm[j];
+        int    b    = j + 1 < snd->frames ? snd->pcm[j + 1] : a;
+        out[i] = (int16_t)lrint(a + (b - a) * frac);
+    }
+
+    sound_free(snd);
+    snd->pcm    = out;
+    snd->owned  = out;
+    snd->frames = frames;
+    snd->rate   = rate;
+    return 0;
+}
+
+/* ================================================================== */
+/*  Output backends                                                     */
+/*                                                                      */
+/*  Every backend is compiled in (ALSA when HAVE_ALSA) behind struct  */
+/*  backend.  At startup each available one is opened, probed for     */
+/*  its trigger-to-first-sample latency and closed again; the         */
+/*  fastest is used and the rest are kept, fastest first, as          */
+/*  fallbacks should it fail mid-contest.                             */
+/*                                                                      */
+/*  A mixing backend takes the mixer's PCM on one persistent stream:  */
+/*    open()   open at *rate (may adjust it)                           */
+/*    write()  queue frames; blocks at the device's pace               */
+/*    idle()   nothing more to play for now (optional)                 */
+/*    probe()  on a fresh stream: estimated latency from write() of   */
+/*             a period to its first sample playing once the stream   */
+/*             is running, ns                                          */
+/*    close()                                                          */
+/*  The fork backend has bell() instead and plays each bell on its    */
+/*  own aplay.  Its probe starts a fresh aplay the way a bell does and */
+/*  times the same thing as the aplay probe, until aplay has read a   */
+/*  period, so the two rank on one scale.                             */
+/* ================================================================== */
+struct sound_setup;
+
+struct backend {
+    const char *name;
+    const char *desc;
+    int       (*open)(const char *device, unsigned int *rate);
+    int       (*write)(const int16_t *pcm, size_t frames);
+    void      (*idle)(void);
+    uint64_t  (*probe)(const char *device, unsigned int rate);
+    void      (*close)(void);
+    int       (*bell)(const struct sound_setup *s, unsigned int id);
+};
+
+/* 's' as one /bin/sh word: in single quotes, each ' inside as '\''.
+   Config values (device, WAV paths) go into aplay command lines only
+   this way.  Returns -1 if the result does not fit in 'size'. */
+static int sh_quote(char *out, size_t size, const char *s)
+{
+    size_t n = 0;
+    if (size < 3) return -1;
+    out[n++] = '\'';
+    for (; *s; s++) {
+        if (n + (*s == '\'' ? 4 : 1) + 2 > size) return -1;
+        if (*s == '\'') {
+            memcpy(out + n, "'\\''", 4);
+            n += 4;
+        } else {
+            out[n++] = *s;
+        }
+    }
+    out[n++] = '\'';
+    out[n]   = '\0';
+    return 0;
+}
+
+/* ---- Raw PCM pipe to a long-lived aplay --------------------------- */
+/*
+ * Streaming to one aplay avoids the shell + aplay fork/exec and the
+ * device open on every bell.  The pipe is shrunk to a single page so
+ * little audio is queued ahead of the mixer.  Between bells aplay sits
+ * in read() and recovers from the resulting underrun on its own.
+ */
+static FILE *g_aplay;
+
+static int aplay_open(const char *device, unsigned int *rate)
+{
+    char dev[4 * 64 + 3], cmd[384];
+    if (sh_quote(dev, sizeof(dev), device) < 0) {
+        fprintf(stderr, "aplay: device name too long\n");
+        return -1;
+    }
+    snprintf(cmd, sizeof(cmd),
+             "aplay -q -D %s -t raw -f S16_LE -r %u -c 1 2>/dev/null",
+             dev, *rate);
+
+    /* A dead aplay must not kill us with SIGPIPE; write() gets EPIPE */
+    signal(SIGPIPE, SIG_IGN);
+    g_aplay = popen(cmd, "w");
+    if (!g_aplay) { perror("popen aplay"); return -1; }
+    fcntl(fileno(g_aplay), F_SETPIPE_SZ, 4096);
+    return 0;
+}
+
+static void aplay_close(void)
+{
+    if (g_aplay) pclose(g_aplay);
+    g_aplay = NULL;
+}
+
+static int aplay_write(const int16_t *pcm, size_t frames)
+{
+    const char *p   = (const char *)pcm;
+    size_t      len = frames * sizeof(int16_t);
+    while (len > 0) {
+        ssize_t rc = write(fileno(g_aplay), p, len);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p   += rc;
+        len -= (size_t)rc;
+    }
+    return 0;
+}
+
+/* Time until aplay has read a period of silence out of the pipe,
+   or UINT64_MAX if it does not within a second. */
+static uint64_t aplay_drain_time(void)
+{
+    static const int16_t silence[MIX_PERIOD];
+    uint64_t t0 = now_ns();
+    if (aplay_write(silence, MIX_PERIOD) < 0) return UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+        int queued;
+        if (ioctl(fileno(g_aplay), FIONREAD, &queued) < 0) break;
+        if (queued == 0) return now_ns() - t0;
+        struct timespec ms = { 0, 1000000 };
+        nanosleep(&ms, NULL);
+    }
+    return UINT64_MAX;
+}
+
+/* The first period waits for aplay to start and open the device,
+   which happens once; the second shows what a bell waits. */
+static uint64_t aplay_probe(const char *device, unsigned int rate)
+{
+    (void)device;
+    (void)rate;
+    if (aplay_drain_time() == UINT64_MAX) return UINT64_MAX;
+    return aplay_drain_time();
+}
+
+static const struct backend be_aplay = {
+    .name  = "aplay",
+    .desc  = "streamed to persistent aplay",
+    .open  = aplay_open,
+    .write = aplay_write,
+    .probe = aplay_probe,
+    .close = aplay_close,
+};
+
+/* ---- ALSA direct -------------------------------------------------- */
+/*
+ * The PCM device is opened and configured once and kept running
+ * between bells.  The buffer is kept to a few mixer periods so a new
+ * bell is never queued far behind the one already playing.  When the
+ * mixer goes idle the tail is drained and the handle re-prepared, so
+ * the next trigger is a plain writei().  If the device errors out and
+ * snd_pcm_recover() cannot fix it, the handle is reopened.
+ */
+#ifdef HAVE_ALSA
+
+static snd_pcm_t *g_pcm;
+
+static int alsa_open(const char *device, unsigned int *rate)
+{
+    snd_pcm_t *handle;
+    int rc;
+
+    rc = snd_pcm_open(&handle, device, SND_PCM_STREAM_PLAYBACK, 0);
+    if (rc < 0) {
+        fprintf(stderr, "ALSA open error: %s\n", snd_strerror(rc));
+        return -1;
+    }
+
+    snd_pcm_hw_params_t *params;
+    snd_pcm_hw_params_alloca(&params);
+    snd_pcm_hw_params_any(handle, params);
+    snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_RW_INTERLEAVED);
+    snd_pcm_hw_params_set_format(handle, params, SND_PCM_FORMAT_S16_LE);
+    snd_pcm_hw_params_set_channels(handle, params, 1);
+    snd_pcm_hw_params_set_rate_near(handle, params, rate, 0);
+
+    snd_pcm_uframes_t period = MIX_PERIOD;
+    snd_pcm_uframes_t bufsz  = 4 * MIX_PERIOD;
+    snd_pcm_hw_params_set_period_size_near(handle, params, &period, 0);
+    snd_pcm_hw_params_set_buffer_size_near(handle, params, &bufsz);
+
+    rc = snd_pcm_hw_params(handle, params);
+    if (rc < 0) {
+        fprintf(stderr, "ALSA hw params error: %s\n", snd_strerror(rc));
+        snd_pcm_close(handle);
+        return -1;
+    }
+
+    rc = snd_pcm_prepare(handle);
+    if (rc < 0) {
+        fprintf(stderr, "ALSA prepare error: %s\n", snd_strerror(rc));
+        snd_pcm_close(handle);
+        return -1;
+    }
+
+    g_pcm = handle;
+    return 0;
+}
+
+static void alsa_close(void)
+{
+    if (g_pcm) snd_pcm_close(g_pcm);
+    g_pcm = NULL;
+}
+
+/* Write all frames, recovering from underruns and suspends. */
+static int alsa_write(const int16_t *pcm, size_t frames)
+{
+    while (frames > 0) {
+        snd_pcm_sframes_t n = snd_pcm_writei(g_pcm, pcm, frames);
+        if (n == -EAGAIN) continue;
+        if (n < 0) {
+            int rc = snd_pcm_recover(g_pcm, (int)n, 1);
+            if (rc < 0) {
+                fprintf(stderr, "ALSA write error: %s\n", snd_strerror(rc));
+                return -1;
+            }
+            continue;
+        }
+        pcm    += n;
+        frames -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Let the last bell finish, then get ready for the next one */
+static void alsa_idle(void)
+{
+    if (!g_pcm) return;
+    snd_pcm_drain(g_pcm);
+    snd_pcm_prepare(g_pcm);
+}
+
+/* Write time plus what is queued ahead of the new period */
+static uint64_t alsa_probe(const char *device, unsigned int rate)
+{
+    (void)device;
+    static const int16_t silence[MIX_PERIOD];
+    uint64_t t0 = now_ns();
+    if (alsa_write(silence, MIX_PERIOD) < 0) return UINT64_MAX;
+    uint64_t t1 = now_ns();
+    snd_pcm_sframes_t delay = 0;
+    if (snd_pcm_delay(g_pcm, &delay) < 0 || delay < 0) delay = MIX_PERIOD;
+    snd_pcm_drop(g_pcm);
+    snd_pcm_prepare(g_pcm);
+    return (t1 - t0) + (uint64_t)delay * 1000000000u / rate;
+}
+
+static const struct backend be_alsa = {
+    .name  = "alsa",
+    .desc  = "via ALSA direct",
+    .open  = alsa_open,
+    .write = alsa_write,
+    .idle  = alsa_idle,
+    .probe = alsa_probe,
+    .close = alsa_close,
+};
+#endif /* HAVE_ALSA */
+
+/* ---- aplay per bell ----------------------------------------------- */
+/*
+ * The original behaviour: system("aplay file &") for every bell,
+ * which forks a shell, which forks aplay, which opens and parses the
+ * file and the sound device.  Only possible with sound = wav.  open()
+ * checks that aplay plays nothing (/dev/null) on the device; the probe
+ * times a fresh aplay from start to reading its first period, which
+ * is the start-up every bell pays before its first sample.
+ */
+static int fork_open(const char *device, unsigned int *rate)
+{
+    char dev[4 * 64 + 3], cmd[384];
+    if (sh_quote(dev, sizeof(dev), device) < 0) return -1;
+    snprintf(cmd, sizeof(cmd),
+             "aplay -q -D %s -t raw -f S16_LE -r %u -c 1 /dev/null "
+             "2>/dev/null", dev, *rate);
+    return system(cmd) == 0 ? 0 : -1;
+}
+
+static void fork_close(void) { }
+
+static uint64_t fork_probe(const char *device, unsigned int rate)
+{
+    if (aplay_open(device, &rate) < 0) return UINT64_MAX;
+    uint64_t lat = aplay_drain_time();
+    aplay_close();
+    return lat;
+}
+
+static int fork_bell(const struct sound_setup *s,   /* sound front end */
+                     unsigned int id);
+
+static const struct backend be_fork = {
+    .name  = "fork",
+    .desc  = "aplay per bell",
+    .open  = fork_open,
+    .probe = fork_probe,
+    .close = fork_close,
+    .bell  = fork_bell,
+};
+
+static const struct backend *const g_backends[] = {
+#ifdef HAVE_ALSA
+    &be_alsa,
+#endif
+    &be_aplay,
+    &be_fork,
+};
+#define N_BACKENDS  (int)(sizeof(g_backends) / sizeof(g_backends[0]))
+
+/* ---- Active output ------------------------------------------------ */
+/*
+ *   out_rank()     probe the backends and rank them (startup)
+ *   out_open()     open the active backend
+ *   out_write()    queue mixed frames; on failure reopen, backing off
+ *                  while it keeps failing; after repeated failures
+ *                  fall back to the next backend
+ *   out_idle()     nothing more to play for now
+ *   out_fallback() switch to the next backend that opens
+ *   out_close()
+ * After startup, only the audio thread touches these.
+ */
+static const struct backend *g_rank[N_BACKENDS];   /* fastest first     */
+static int                   g_nrank;
+static int                   g_out_idx;            /* into g_rank       */
+static const struct backend *g_out = &be_aplay;    /* g_rank[g_out_idx] */
+static int                   g_out_open;
+static uint64_t              g_out_opened_ns;
+static atomic_uint           g_out_rate;  /* read by the config thread */
+static char                  g_out_device[64];
+
+static int out_open(const char *device, unsigned int *rate)
+{
+    if (device != g_out_device)
+        snprintf(g_out_device, sizeof(g_out_device), "%s", device);
+    if (g_out->open(g_out_device, rate) < 0) return -1;
+    g_out_open      = 1;
+    g_out_opened_ns = now_ns();
+    g_out_rate = *rate;
+    return 0;
+}
+
+static void out_close(void)
+{
+    if (g_out_open) g_out->close();
+    g_out_open = 0;
+}
+
+static void out_idle(void)
+{
+    if (g_out_open && g_out->idle) g_out->idle();
+}
+
+static int out_fallback(void)
+{
+    out_close();
+    for (int i = 1; i < g_nrank; i++) {
+        int idx = (g_out_idx + i) % g_nrank;
+        unsigned int rate = g_out_rate;
+        g_out = g_rank[idx];
+        if (out_open(g_out_device, &rate) == 0) {
+            g_out_idx = idx;
+            fprintf(stderr, "Warning: sound output switched to %s\n",
+                    g_out->name);
+            return 0;
+        }
+    }
+    g_out = g_rank[g_out_idx];   /* nothing else works; keep retrying */
+    return -1;
+}
+
+/* A reopened aplay pipe takes writes until aplay dies again, so one
+   successful write proves little.  OUT_FAIL_LIMIT failures within
+   OUT_FAIL_WINDOW_S retire the backend instead.  The first failure
+   of a stream that has taken writes for OUT_HEALTHY_MS reopens at
+   once; further ones wait OUT_RETRY_MIN_MS, doubling up to
+   OUT_RETRY_MAX_MS, so an output that does not work at all is not
+   reopened (and reported) every mixer period.  Periods mixed
+   meanwhile are dropped. */
+#define OUT_FAIL_LIMIT     3
+#define OUT_FAIL_WINDOW_S  10
+#define OUT_RETRY_MIN_MS   100
+#define OUT_RETRY_MAX_MS   10000
+#define OUT_HEALTHY_MS     1000
+
+static uint64_t     g_out_retry_ns;      /* no reopen before this      */
+static unsigned int g_out_backoff_ms;    /* next wait; 0 = healthy     */
+
+static void out_failed(const char *what)
+{
+    static uint64_t since;
+    static int      fails;
+    uint64_t now  = now_ns();
+    unsigned wait = g_out_backoff_ms;
+
+    out_close();
+    if (wait == 0)
+        fprintf(stderr, "Warning: %s output %s, reopening\n",
+                g_out->name, what);
+    else
+        fprintf(stderr, "Warning: %s output %s, retrying in %u ms\n",
+                g_out->name, what, wait);
+    g_out_retry_ns   = now + wait * 1000000ull;
+    g_out_backoff_ms = wait == 0 ? OUT_RETRY_MIN_MS
+                     : wait >= OUT_RETRY_MAX_MS / 2 ? OUT_RETRY_MAX_MS
+                     : 2 * wait;
+
+    if (now - since > OUT_FAIL_WINDOW_S * 1000000000ull) {
+        since = now;
+        fails = 0;
+    }
+    if (++fails >= OUT_FAIL_LIMIT) {
+        fails = 0;
+        if (out_fallback() == 0) {         /* a fresh backend: no wait */
+            g_out_retry_ns   = 0;
+            g_out_backoff_ms = 0;
+        }
+    }
+}
+
+static int out_write(const int16_t *pcm, size_t frames)
+{
+    /* g_out->write is NULL once fallen back to the fork backend */
+    for (int attempt = 0; attempt < 2 && g_out->write; attempt++) {
+        if (!g_out_open) {
+            unsigned int rate = g_out_rate;
+            if (now_ns() < g_out_retry_ns) return -1;   /* backing off */
+            if (out_open(g_out_device, &rate) < 0) {
+                out_failed("does not open");
+                continue;
+            }
+        }
+        if (g_out->write(pcm, frames) == 0) {
+            if (g_out_backoff_ms &&
+                now_ns() - g_out_opened_ns > OUT_HEALTHY_MS * 1000000ull)
+                g_out_backoff_ms = 0;
+            return 0;
+        }
+        out_failed("failed");
+    }
+    return -1;
+}
+
+/* Open, probe and close every backend that can play this sound, and
+   rank the working ones by first-sample latency.  'prefer' (a backend
+   name or "auto") goes first if it works.  Returns the number ranked. */
+static int out_rank(const char *device, unsigned int rate, int wav,
+                    const char *prefer)
+{
+    uint64_t sort_key[N_BACKENDS];
+    g_nrank = 0;
+
+    for (int i = 0; i < N_BACKENDS; i++) {
+        const struct backend *b = g_backends[i];
+        printf("Probe     : %-6s", b->name);
+        if (b->bell && !wav) {
+            printf("not used (plays WAV files only)\n");
+            continue;
+        }
+        fflush(stdout);
+
+        unsigned int r  = rate;
+        uint64_t     t0 = now_ns();
+        if (b->open(device, &r) < 0) {
+            printf("does not open\n");
+            continue;
+        }
+        uint64_t lat   = b->probe(device, r);
+        uint64_t up_ns = now_ns() - t0;
+        b->close();
+        if (lat == UINT64_MAX) {
+            printf("opens, but does not play\n");
+            continue;
+        }
+        printf("start-up %7.1f ms, first sample %7.1f ms\n",
+               (double)up_ns / 1e6, (double)lat / 1e6);
+
+        /* Insertion sort by latency; the preferred backend sorts first */
+        uint64_t key = strcmp(b->name, prefer) == 0 ? 0 : lat;
+        int      at  = g_nrank++;
+        for (; at > 0 && key < sort_key[at - 1]; at--) {
+            g_rank[at]   = g_rank[at - 1];
+            sort_key[at] = sort_key[at - 1];
+        }
+        g_rank[at]   = b;
+        sort_key[at] = key;
+    }
+    return g_nrank;
+}
+
+/* ================================================================== */
+/*  Mixer                                                               */
+/*                                                                      */
+/*  Up to MIX_VOICES bells play at once on the single output stream.  */
+/*  Each trigger starts a voice; the audio thread sums all active     */
+/*  voices MIX_PERIOD frames at a time with saturating 16-bit adds.  */
+/*  When all voices are busy the one furthest along is restarted.     */
+/* ================================================================== */
+struct voice {
+    const int16_t  *pcm;         /* NULL when free                     */
+    size_t          frames;
+    size_t          pos;
+    size_t          delay;       /* silent frames before pos 0         */
+    int             fresh;       /* nothing written yet                */
+    struct trigger_event ev;     /* for latency accounting             */
+};
+
+static struct voice       g_voices[MIX_VOICES];
+static int16_t            g_mix[MIX_PERIOD] __attribute__((aligned(16)));
+static unsigned long long g_voices_stolen;
+
+/* dst[i] = saturate(dst[i] + src[i]) */
+static void mix_add_s16(int16_t *dst, const int16_t *src, size_t n)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i d = _mm_load_si128((const __m128i *)(dst + i));
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_store_si128((__m128i *)(dst + i), _mm_adds_epi16(d, s));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= n; i += 8)
+        vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+#endif
+    for (; i < n; i++) {
+        int s = dst[i] + src[i];
+        dst[i] = (int16_t)(s > 32767 ? 32767 : s < -32768 ? -32768 : s);
+    }
+}
+
+/* Start 'snd' after 'delay' frames.  Only a voice with an event
+   counts towards the latency histograms. */
+static void voice_start(const struct sound *snd,
+                        const struct trigger_event *ev, size_t delay)
+{
+    if (!snd->pcm || !snd->frames) return;
+
+    struct voice *v = NULL;
+    for (int i = 0; i < MIX_VOICES; i++) {
+        if (!g_voices[i].pcm) { v = &g_voices[i]; break; }
+        if (!v || g_voices[i].pos > v->pos) v = &g_voices[i];
+    }
+    if (v->pcm) g_voices_stolen++;
+
+    v->pcm    = snd->pcm;
+    v->frames = snd->frames;
+    v->pos    = 0;
+    v->delay  = delay & ~(size_t)7;   /* keep g_mix + delay 16-byte aligned */
+    v->fresh  = ev != NULL;
+    if (ev) v->ev = *ev;
+}
+
+static int mixer_busy(void)
+{
+    for (int i = 0; i < MIX_VOICES; i++)
+        if (g_voices[i].pcm) return 1;
+    return 0;
+}
+
+/* Mix the next period into g_mix.  Returns frames produced (0 if no
+   voice is active).  'fresh' collects the trigger events of voices
+   that started in this period, for latency accounting after write. */
+static size_t mix_period(struct trigger_event *fresh, int *nfresh)
+{
+    size_t out = 0;
+    *nfresh = 0;
+    memset(g_mix, 0, sizeof(g_mix));
+
+    for (int i = 0; i < MIX_VOICES; i++) {
+        struct voice *v = &g_voices[i];
+        if (!v->pcm) continue;
+
+        size_t at = v->delay < MIX_PERIOD ? v->delay : MIX_PERIOD;
+        v->delay -= at;
+        size_t n = v->frames - v->pos;
+        if (n > MIX_PERIOD - at) n = MIX_PERIOD - at;
+        mix_add_s16(g_mix + at, v->pcm + v->pos, n);
+        if (at + n > out) out = at + n;
+        if (n == 0 && v->pos < v->frames) continue;     /* still delayed */
+
+        if (v->fresh) {
+            fresh[(*nfresh)++] = v->ev;
+            v->fresh = 0;
+        }
+        v->pos += n;
+        if (v->pos >= v->frames) v->pcm = NULL;
+    }
+    return out;
+}
+
+/* ================================================================== */
+/*  Sound front end                                                     */
+/*                                                                      */
+/*  sound_init() runs once at startup, before the audio thread        */
+/*  exists; play_sound() and sound_shutdown() run on the audio thread */
+/*  and at exit respectively.                                          */
+/*                                                                      */
+/*  The sound bank and the output device it is meant for travel       */
+/*  together in a sound_setup.  The bank holds the bell plus the      */
+/*  mult1..mult3 sounds that differ from it, all as PCM at the bell's */
+/*  rate; by_mask[] maps the mult slots behind a bell to its sound,   */
+/*  the lowest slot winning.  A config reload builds a new setup on   */
+/*  the config thread (file loading and tone rendering happen there)  */
+/*  and publishes it with one pointer exchange; the audio thread      */
+/*  adopts it the next time the mixer is idle, when no voice still    */
+/*  points into the old sounds, and frees the old one.                */
+/*                                                                      */
+/*  The fork backend bypasses the mixer.  Its first-sample latency is */
+/*  only the time until system() returns, a lower bound since aplay   */
+/*  has not started playing yet.                                       */
+/* ================================================================== */
+#define SOUND_BANK_MAX  4        /* the bell + one per mult slot       */
+
+struct sound_setup {
+    struct sound snd[SOUND_BANK_MAX];    /* [0] = the bell             */
+    char         wav_file[SOUND_BANK_MAX][256];  /* "" for a tone; for
+                                                    the fork backend   */
+    unsigned int nsounds;
+    uint8_t      by_mask[8];     /* mult slot mask -> snd[]            */
+    char         device[64];
+};
+
+static struct sound_setup *g_setup;             /* audio thread's      */
+static _Atomic(struct sound_setup *) g_setup_pending;
+static unsigned long long  g_fork_bells;
+
+static void setup_free(struct sound_setup *s)
+{
+    if (!s) return;
+    for (unsigned int i = 0; i < s->nsounds; i++)
+        sound_free(&s->snd[i]);
+    free(s);
+}
+
+/* Add the sound for mult slot 'slot' to the bank and return its index.
+   The bell, a spec already in the bank, or one that fails to load
+   (reported) all map to the bell. */
+static unsigned int setup_add_sound(struct sound_setup *s,
+                                    const struct config *c, int slot)
+{
+    const char *spec = c->mult_sound[slot];
+    if (!*spec) return 0;
+    for (int i = 0; i < slot; i++)
+        if (strcmp(c->mult_sound[i], spec) == 0)
+            return s->by_mask[1u << i];
+
+    struct sound *snd = &s->snd[s->nsounds];
+    unsigned int  freq, ms = c->beep_ms;
+    int rc = sound_spec_tone(spec, &freq, &ms) > 0
+           ? tone_render(freq, ms, c->beep_volume, s->snd[0].rate, snd)
+           : wav_load(spec, snd);
+    if (rc == 0 && sound_resample(snd, s->snd[0].rate) < 0) {
+        sound_free(snd);
+        rc = -1;
+    }
+    if (rc < 0) {
+        fprintf(stderr, "Warning: mult%d plays the bell\n", slot + 1);
+        return 0;
+    }
+    if (strncmp(spec, "tone", 4) != 0)
+        snprintf(s->wav_file[s->nsounds], sizeof(s->wav_file[0]), "%s",
+                 spec);
+    return s->nsounds++;
+}
+
+/* Load or render the sounds 'c' asks for.  A tone is rendered at
+   'rate'; a WAV bell keeps its own rate and the other sounds are
+   converted to it.  The PCM is loaded even for the fork backend, in
+   case it has to fall back to a mixing one. */
+static struct sound_setup *setup_build(const struct config *c,
+                                       unsigned int rate)
+{
+    struct sound_setup *s = calloc(1, sizeof(*s));
+    if (!s) { perror("calloc"); return NULL; }
+    snprintf(s->device, sizeof(s->device), "%s", c->device);
+
+    int rc = c->tone ? tone_render(c->beep_freq, c->beep_ms, c->beep_volume,
+                                   rate, &s->snd[0])
+                     : wav_load(c->wav_file, &s->snd[0]);
+    if (rc < 0) { free(s); return NULL; }
+    if (!c->tone)
+        snprintf(s->wav_file[0], sizeof(s->wav_file[0]), "%s", c->wav_file);
+    s->nsounds = 1;
+
+    for (int slot = 0; slot < 3; slot++)
+        s->by_mask[1u << slot] = (uint8_t)setup_add_sound(s, c, slot);
+    for (unsigned int m = 3; m < 8; m++)
+        if (m & (m - 1))                    /* several slots: lowest */
+            s->by_mask[m] = s->by_mask[m & -m];
+    return s;
+}
+
+static int fork_bell(const struct sound_setup *s, unsigned int id)
+{
+    if (!s->wav_file[id][0]) return -1;
+    char dev[4 * sizeof(s->device) + 3];
+    char file[4 * sizeof(s->wav_file[0]) + 3];
+    char cmd[sizeof(dev) + sizeof(file) + 32];
+    if (sh_quote(dev, sizeof(dev), s->device) < 0 ||
+        sh_quote(file, sizeof(file), s->wav_file[id]) < 0)
+        return -1;
+    snprintf(cmd, sizeof(cmd), "aplay -q -D %s -- %s &", dev, file);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "Warning: aplay returned error\n");
+        return -1;
+    }
+    g_fork_bells++;
+    return 0;
+}
+
+/* Load the sound, pick the output backend ('prefer' or the fastest
+   that works) and open it. */
+static int sound_init(const struct config *c, const char *prefer)
+{
+    /* A WAV file opens the device at its own rate; a tone is then
+       rendered at whatever rate the device accepted. */
+    unsigned int rate = SAMPLE_RATE;
+    if (!c->tone) {
+        g_setup = setup_build(c, 0);
+        if (g_setup) rate = g_setup->snd[0].rate;
+    }
+
+    if (out_rank(c->device, rate, g_setup != NULL, prefer) == 0) {
+        g_rank[0] = &be_aplay;   /* keep retrying it on each bell */
+        g_nrank   = 1;
+    }
+    g_out_idx = 0;
+    g_out     = g_rank[0];
+    snprintf(g_out_device, sizeof(g_out_device), "%s", c->device);
+    g_out_rate = rate;
+    int rc = out_open(c->device, &rate);
+    if (rc < 0) rc = out_fallback();
+
+    if (c->tone) g_setup = setup_build(c, g_out_rate);
+    return g_setup ? rc : -1;
+}
+
+/* Audio thread, mixer idle: switch to a newly published setup */
+static void setup_adopt(void)
+{
+    struct sound_setup *s = atomic_exchange(&g_setup_pending, NULL);
+    if (!s) return;
+
+    struct sound_setup *old = g_setup;
+    g_setup = s;
+    unsigned int want = s->snd[0].rate;
+    if (want != g_out_rate || strcmp(s->device, g_out_device) != 0) {
+        unsigned int rate = want;
+        out_close();
+        if (out_open(s->device, &rate) == 0 && rate != want)
+            fprintf(stderr, "Warning: %s plays at %u Hz, not %u Hz\n",
+                    s->device, rate, want);
+    }
+    setup_free(old);
+}
+
+/* Ring one bell with the sound for its mult slots, struck 'strikes'
+   times MULTI_RING_GAP_MS apart.  The latency event rides on the
+   first strike. */
+static void play_sound(const struct trigger_event *ev, unsigned strikes)
+{
+    const struct sound_setup *s = g_setup;
+    if (!s) return;              /* no sound loaded; wait for a reload */
+    unsigned int id = s->by_mask[ev->mults & 7];
+    if (g_out->bell) {
+        if (g_out->bell(s, id) == 0) {
+            lat_first_sample(ev);
+            return;
+        }
+        if (out_fallback() < 0 || g_out->bell) return;
+    }
+    size_t gap = (size_t)s->snd[0].rate * MULTI_RING_GAP_MS / 1000;
+    for (unsigned i = 0; i < strikes; i++)
+        voice_start(&s->snd[id], i == 0 ? ev : NULL, i * gap);
+}
+
+static void sound_shutdown(void)
+{
+    out_close();
+    setup_free(g_setup);
+    setup_free(atomic_exchange(&g_setup_pending, NULL));
+    g_setup = NULL;
+
+    if (g_fork_bells)
+        printf("Note: for the %llu bells played by the fork backend, "
+               "'sample' is when system() returned, a lower bound on "
+               "aplay's first sample\n", g_fork_bells);
+    if (g_voices_stolen)
+        printf("Voices restarted (all %d busy): %llu\n",
+               MIX_VOICES, g_voices_stolen);
+}
+#endif /* LISTENER_NO_MAIN */
+
+/* ================================================================== */
+/*  Single-producer / single-consumer lock-free ring                    */
+/*                                                                      */
+/*  Fixed-size slots, capacity a power of two.  The producer owns      */
+/*  'tail', the consumer owns 'head'; each only reads the other's      */
+/*  index.  Neither side ever blocks or takes a lock.                  */
+/* ================================================================== */
+struct spsc_ring {
+    _Atomic unsigned int head __attribute__((aligned(64)));
+    _Atomic unsigned int tail __attribute__((aligned(64)));
+    unsigned int  mask;
+    size_t        elem_size;
+    unsigned char *slots;
+};
+
+static int spsc_init(struct spsc_ring *r, unsigned int capacity,
+                     size_t elem_size)
+{
+    if (capacity == 0 || (capacity & (capacity - 1))) return -1;
+    r->slots = calloc(capacity, elem_size);
+    if (!r->slots) return -1;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    r->mask      = capacity - 1;
+    r->elem_size = elem_size;
+    return 0;
+}
+
+/* Returns 0 on success, -1 if the ring is full. */
+static int spsc_push(struct spsc_ring *r, const void *elem)
+{
+    unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (tail - head > r->mask) return -1;
+    memcpy(r->slots + (size_t)(tail & r->mask) * r->elem_size,
+           elem, r->elem_size);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+#ifndef LISTENER_NO_MAIN
+/* The oldest element in place, or NULL if the ring is empty.  Stays
+   valid until the consumer pops it. */
+static const void *spsc_peek(struct spsc_ring *r)
+{
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head == tail) return NULL;
+    return r->slots + (size_t)(head & r->mask) * r->elem_size;
+}
+#endif /* LISTENER_NO_MAIN */
+
+/* Returns 0 on success, -1 if the ring is empty. */
+static int spsc_pop(struct spsc_ring *r, void *elem)
+{
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head == tail) return -1;
+    memcpy(elem, r->slots + (size_t)(head & r->mask) * r->elem_size,
+           r->elem_size);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return 0;
+}
+
+#ifndef LISTENER_NO_MAIN
+/* Start a helper thread with SIGINT/SIGTERM/SIGUSR1 blocked, so those
+   signals reach the receive loop's signalfd (or the replay) rather
+   than a sleeping helper. */
+static int thread_start(pthread_t *tid, void *(*fn)(void *), void *arg)
+{
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int rc = pthread_create(tid, NULL, fn, arg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) { errno = rc; return -1; }
+    return 0;
+}
+
+/* ================================================================== */
+/*  Bell scheduler                                                      */
+/*                                                                      */
+/*  Runs on the audio thread between the trigger ring and             */
+/*  play_sound().  A trigger outside any window rings immediately and */
+/*  opens a window of g_coalesce_ms; triggers inside it are counted   */
+/*  and rung as a single (multi-strike) bell when it closes, which     */
+/*  opens the next window.  Every bell takes a token from a bucket    */
+/*  refilled at g_bells_per_min, so a long burst costs at most one    */
+/*  bell per window and BELL_BURST bells ahead of the refill rate.   */
+/* ================================================================== */
+/* Set from the config; a reload stores new values at any time */
+static atomic_uint g_coalesce_ms   = COALESCE_MS;
+static atomic_uint g_multi_ring    = MULTI_RING_MAX;
+static atomic_uint g_bells_per_min = BELLS_PER_MIN;
+
+struct bell_sched {
+    uint64_t             window_end;  /* ns; no window once passed     */
+    unsigned             pending;     /* triggers held for window_end  */
+    struct trigger_event first;       /* oldest held trigger           */
+    double               tokens;
+    uint64_t             refill_ns;   /* last token refill             */
+    unsigned long long   bells, coalesced, limited;
+};
+
+static struct bell_sched g_sched;
+
+static void sched_init(struct bell_sched *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->tokens    = BELL_BURST;
+    s->refill_ns = now_ns();
+}
+
+static int sched_take_token(struct bell_sched *s, uint64_t now)
+{
+    unsigned int per_min = atomic_load(&g_bells_per_min);
+    if (per_min == 0) return 1;
+    if (now > s->refill_ns) {
+        s->tokens += (double)(now - s->refill_ns) * per_min / 60e9;
+        if (s->tokens > BELL_BURST) s->tokens = BELL_BURST;
+    }
+    s->refill_ns = now;
+    if (s->tokens < 1.0) return 0;
+    s->tokens -= 1.0;
+    return 1;
+}
+
+/* Ring one bell for 'count' triggers and open the next window. */
+static void sched_ring(struct bell_sched *s, const struct trigger_event *ev,
+                       unsigned count, uint64_t now)
+{
+    s->window_end = now + (uint64_t)atomic_load(&g_coalesce_ms) * 1000000u;
+    if (!sched_take_token(s, now)) {
+        s->limited += count;
+        return;
+    }
+    s->bells++;
+    s->coalesced += count - 1;
+    unsigned int strikes = atomic_load(&g_multi_ring);
+    play_sound(ev, count < strikes ? count : strikes);
+}
+
+static void sched_trigger(struct bell_sched *s, const struct trigger_event *ev)
+{
+    uint64_t now = now_ns();
+    if (now >= s->window_end && s->pending == 0) {
+        sched_ring(s, ev, 1, now);
+        return;
+    }
+    if (s->pending++ == 0) s->first = *ev;
+    else s->first.mults |= ev->mults;
+}
+
+/* Ring the held triggers if their window has closed.  Returns the
+   time still to wait in ns, or 0 if nothing is held. */
+static uint64_t sched_poll(struct bell_sched *s)
+{
+    if (s->pending == 0) return 0;
+    uint64_t now = now_ns();
+    if (now < s->window_end) return s->window_end - now;
+    unsigned n = s->pending;
+    s->pending = 0;
+    sched_ring(s, &s->first, n, now);
+    return 0;
+}
+
+static void sched_report(const struct bell_sched *s)
+{
+    printf("Bells: %llu rung, %llu triggers coalesced, %llu over the "
+           "rate limit\n", s->bells, s->coalesced, s->limited);
+}
+#endif /* LISTENER_NO_MAIN */
+
+/* ================================================================== */
+/*  Audio thread                                                        */
+/*                                                                      */
+/*  Owns the mixer and the output stream, which blocks at the device's */
+/*  pace.  The receive thread only pushes a trigger event and posts    */
+/*  the semaphore; it never waits for audio.  While any voice is      */
+/*  playing the thread polls the ring once per mixer period; when all */
+/*  are silent it sleeps on the semaphore.                             */
+/* ================================================================== */
+static struct spsc_ring     g_trigger_ring;
+static sem_t                g_audio_wake;
+static unsigned long long   g_triggers_dropped;   /* receive thread only */
+
+#ifndef LISTENER_NO_MAIN
+static atomic_int           g_audio_stop;
+
+static void *audio_thread(void *arg)
+{
+    (void)arg;
+    struct trigger_event ev;
+    struct trigger_event fresh[MIX_VOICES];
+    int                  playing = 0;
+
+    for (;;) {
+        uint64_t wait_ns = sched_poll(&g_sched);
+        if (!mixer_busy()) {
+            if (playing) { out_idle(); playing = 0; }
+            setup_adopt();
+            if (wait_ns == 0) {
+                if (atomic_load(&g_audio_stop)) break;
+                while (sem_wait(&g_audio_wake) < 0 && errno == EINTR)
+                    ;
+            } else {
+                /* Sleep until the coalescing window closes */
+                uint64_t until = now_ns() + wait_ns;
+                struct timespec ts = {
+                    .tv_sec  = (time_t)(until / 1000000000u),
+                    .tv_nsec = (long)(until % 1000000000u),
+                };
+                while (sem_timedwait(&g_audio_wake, &ts) < 0 &&
+                       errno == EINTR)
+                    ;
+            }
+        }
+        while (spsc_pop(&g_trigger_ring, &ev) == 0)
+            sched_trigger(&g_sched, &ev);
+        sched_poll(&g_sched);
+
+        int    nfresh;
+        size_t n = mix_period(fresh, &nfresh);
+        if (n == 0) continue;
+        playing = 1;
+        if (out_write(g_mix, n) < 0) continue;
+        for (int i = 0; i < nfresh; i++)
+            lat_first_sample(&fresh[i]);
+    }
+    return NULL;
+}
+#endif /* LISTENER_NO_MAIN */
+
+/* Receive-thread side: queue one bell for mult slots 'mults'.  Never
+   blocks; -1 if the ring was full and the bell dropped. */
+static int trigger_sound(uint64_t rx_ns, uint64_t trigger_ns,
+                         unsigned mults)
+{
+    struct trigger_event ev = { .rx_ns = rx_ns, .trigger_ns = trigger_ns,
+                                .mults = mults };
+    if (spsc_push(&g_trigger_ring, &ev) < 0) {
+        g_triggers_dropped++;
+        return -1;
+    }
+    sem_post(&g_audio_wake);
+    return 0;
+}
+
+#ifndef LISTENER_NO_MAIN
+static int audio_start(pthread_t *tid)
+{
+    if (spsc_init(&g_trigger_ring, AUDIO_QUEUE_LEN,
+                  sizeof(struct trigger_event)) < 0)
+        return -1;
+    if (sem_init(&g_audio_wake, 0, 0) < 0) return -1;
+    atomic_init(&g_audio_stop, 0);
+    sched_init(&g_sched);
+    return thread_start(tid, audio_thread, NULL);
+}
+
+/* Let the audio thread finish any playing bells, then join it. */
+static void audio_stop(pthread_t tid)
+{
+    atomic_store(&g_audio_stop, 1);
+    sem_post(&g_audio_wake);
+    pthread_join(tid, NULL);
+}
+#endif /* LISTENER_NO_MAIN */
+
+/* ================================================================== */
+/*  Config thread                                                       */
+/*                                                                      */
+/*  Watches the config file's directory with inotify (editors often   */
+/*  write a new file and rename it over the old one) and re-reads the */
+/*  file when it is written or replaced.  A file with errors is       */
+/*  reported and ignored.  Otherwise:                                  */
+/*    - scheduler settings are stored into atomics, used from the     */
+/*      next bell on;                                                  */
+/*    - a new sound or device is loaded/rendered here and published   */
+/*      to the audio thread (setup_publish());                        */
+/*    - a new listen set is published with one pointer exchange and */
+/*      the receive loop woken through its eventfd; it opens the new  */
+/*      sockets before closing the old ones, so no datagram is lost   */
+/*      in between.  A new receive buffer size or report interval is  */
+/*      picked up the same way.                                        */
+/* ================================================================== */
+static atomic_int   g_trigger_local; /* trigger = local                */
+#ifndef LISTENER_NO_MAIN
+static atomic_uint  g_rcvbuf;        /* SO_RCVBUF to ask for           */
+static atomic_uint  g_stats_interval;
+static _Atomic(struct listen_set *) g_listen_pending;
+static int          g_recv_wake = -1;   /* eventfd of the receive loop */
+
+static const char  *g_config_path;
+static struct config g_config;       /* config thread's after start    */
+static int          g_config_stopfd = -1;
+
+static void config_apply(const struct config *c)
+{
+    atomic_store(&g_coalesce_ms,   c->coalesce_ms);
+    atomic_store(&g_multi_ring,    c->strikes);
+    atomic_store(&g_bells_per_min, c->bells_per_min);
+    atomic_store(&g_trigger_local, c->trigger_local);
+    atomic_store(&g_rcvbuf,        c->rcvbuf);
+    atomic_store(&g_stats_interval, c->stats_interval);
+}
+
+static void setup_publish(struct sound_setup *s)
+{
+    /* A setup published earlier but not yet adopted is never used */
+    setup_free(atomic_exchange(&g_setup_pending, s));
+    sem_post(&g_audio_wake);
+}
+
+static void config_reload(void)
+{
+    struct config c;
+    if (config_load(g_config_path, &c, 0) < 0) {
+        fprintf(stderr, "%s: not reloaded, keeping previous settings\n",
+                g_config_path);
+        return;
+    }
+
+    if (config_sound_changed(&g_config, &c)) {
+        unsigned int rate = g_out_rate;
+        struct sound_setup *s = setup_build(&c, rate ? rate : SAMPLE_RATE);
+        if (!s) {
+            fprintf(stderr, "%s: not reloaded, keeping previous sound\n",
+                    g_config_path);
+            return;
+        }
+        setup_publish(s);
+    }
+    config_apply(&c);
+    int wake = c.rcvbuf != g_config.rcvbuf ||
+               c.stats_interval != g_config.stats_interval;
+    if (!listen_set_eq(&c.listen, &g_config.listen)) {
+        struct listen_set *ls = malloc(sizeof(*ls));
+        if (ls) {
+            *ls  = c.listen;
+            wake = 1;
+            free(atomic_exchange(&g_listen_pending, ls));
+        } else {
+            perror("malloc");
+        }
+    }
+    if (wake) {
+        uint64_t one = 1;
+        if (write(g_recv_wake, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            perror("receive wake");
+    }
+    g_config = c;
+
+    printf("Config    : reloaded %s\n", g_config_path);
+    fflush(stdout);
+}
+
+static void *config_thread(void *arg)
+{
+    (void)arg;
+    char dir_buf[256], name_buf[256];
+    snprintf(dir_buf,  sizeof(dir_buf),  "%s", g_config_path);
+    snprintf(name_buf, sizeof(name_buf), "%s", g_config_path);
+    const char *dir  = dirname(dir_buf);
+    const char *name = basename(name_buf);
+
+    int ifd = inotify_init1(IN_CLOEXEC);
+    if (ifd < 0 ||
+        inotify_add_watch(ifd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "Warning: cannot watch %s (%s), no hot reload\n",
+                dir, strerror(errno));
+        if (ifd >= 0) close(ifd);
+        return NULL;
+    }
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd[2] = {
+        { .fd = ifd,             .events = POLLIN },
+        { .fd = g_config_stopfd, .events = POLLIN },
+    };
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (pfd[1].revents) break;
+
+        ssize_t n = read(ifd, buf, sizeof(buf));
+        if (n <= 0) continue;
+        int changed = 0;
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (ev->len && strcmp(ev->name, name) == 0) changed = 1;
+            p += sizeof(*ev) + ev->len;
+        }
+        if (changed) config_reload();
+    }
+    close(ifd);
+    return NULL;
+}
+
+static int config_start(pthread_t *tid, const char *path,
+                        const struct config *c)
+{
+    g_config_path   = path;
+    g_config        = *c;
+    g_config_stopfd = eventfd(0, EFD_CLOEXEC);
+    if (g_config_stopfd < 0) return -1;
+    return thread_start(tid, config_thread, NULL);
+}
+
+static void config_stop(pthread_t tid)
+{
+    uint64_t one = 1;
+    if (write(g_config_stopfd, &one, sizeof(one)) < 0)
+        perror("config stop");
+    pthread_join(tid, NULL);
+    close(g_config_stopfd);
+}
+#endif /* LISTENER_NO_MAIN */
+
+/* ================================================================== */
+/*  Duplicate contact cache                                             */
+/*                                                                      */
+/*  DXLog can send the same contactinfo more than once (retransmits,  */
+/*  several interfaces, resync after a station rejoins).  Each        */
+/*  bell-worthy contact is reduced to a 64-bit key, from its <ID> if  */
+/*  present, else from call/band/mode/station/timestamp.  Keys live in */
+/*  a linear-probing hash table at most half full, and in a FIFO ring */
+/*  in insertion order; when the ring is full the oldest key is       */
+/*  evicted from the table.  Everything is fixed size.                */
+/* ================================================================== */
+#define DEDUP_SLOTS  (2 * DEDUP_ENTRIES)
+
+struct dedup_slot {
+    uint64_t key;                /* 0 = empty                          */
+    uint64_t seen_ns;            /* last time this contact was seen    */
+};
+
+struct dedup_cache {
+    uint64_t          hits, misses, evictions;
+    uint32_t          head;      /* oldest ring entry                  */
+    uint32_t          count;     /* ring entries in use                */
+    uint64_t          ring[DEDUP_ENTRIES];
+    struct dedup_slot slot[DEDUP_SLOTS];
+};
+
+static uint64_t fnv1a_slice(uint64_t h, const struct xml_slice *s)
+{
+    for (size_t i = 0; i < s->len; i++) {
+        h ^= (unsigned char)tolower((unsigned char)s->p[i]);
+        h *= 0x100000001b3ull;
+    }
+    h ^= 0xff;                   /* field separator                    */
+    return h * 0x100000001b3ull;
+}
+
+static uint64_t dedup_key(const struct xml_fields *fl)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    if (fl->f[FLD_ID].len) {
+        h = fnv1a_slice(h, &fl->f[FLD_ID]);
+    } else {
+        static const int id_fields[] = {
+            FLD_CALL, FLD_BAND, FLD_MODE, FLD_STATION, FLD_TIMESTAMP
+        };
+        for (size_t i = 0; i < sizeof(id_fields) / sizeof(id_fields[0]); i++)
+            h = fnv1a_slice(h, &fl->f[id_fields[i]]);
+    }
+    return h ? h : 1;
+}
+
+static uint32_t dedup_home(uint64_t key)
+{
+    return (uint32_t)(key ^ (key >> 29)) & (DEDUP_SLOTS - 1);
+}
+
+static struct dedup_slot *dedup_find(struct dedup_cache *c, uint64_t key)
+{
+    for (uint32_t i = dedup_home(key); ; i = (i + 1) & (DEDUP_SLOTS - 1)) {
+        if (c->slot[i].key == key) return &c->slot[i];
+        if (c->slot[i].key == 0)   return NULL;
+    }
+}
+
+/* Remove a key, shifting later members of its probe run back so no
+   tombstones are needed. */
+static void dedup_erase(struct dedup_cache *c, uint64_t key)
+{
+    struct dedup_slot *s = dedup_find(c, key);
+    if (!s) return;
+
+    uint32_t hole = (uint32_t)(s - c->slot);
+    for (uint32_t j = (hole + 1) & (DEDUP_SLOTS - 1);
+         c->slot[j].key != 0; j = (j + 1) & (DEDUP_SLOTS - 1)) {
+        uint32_t home = dedup_home(c->slot[j].key);
+        /* Move j into the hole unless its home lies in (hole, j] */
+        int stays = hole <= j ? (home > hole && home <= j)
+                              : (home > hole || home <= j);
+        if (!stays) {
+            c->slot[hole] = c->slot[j];
+            hole = j;
+        }
+    }
+    c->slot[hole].key = 0;
+}
+
+/* Returns 1 if the contact was already seen within the window,
+   otherwise remembers it and returns 0. */
+static int dedup_check(struct dedup_cache *c, uint64_t key, uint64_t now)
+{
+    struct dedup_slot *s = dedup_find(c, key);
+    if (s) {
+        int fresh = DEDUP_WINDOW_S == 0 ||
+                    now - s->seen_ns < (uint64_t)DEDUP_WINDOW_S * 1000000000ull;
+        s->seen_ns = now;
+        if (fresh) { c->hits++; return 1; }
+        c->misses++;
+        return 0;
+    }
+
+    c->misses++;
+    if (c->count == DEDUP_ENTRIES) {
+        dedup_erase(c, c->ring[c->head]);
+        c->head = (c->head + 1) & (DEDUP_ENTRIES - 1);
+        c->count--;
+        c->evictions++;
+    }
+    c->ring[(c->head + c->count) & (DEDUP_ENTRIES - 1)] = key;
+    c->count++;
+
+    uint32_t i = dedup_home(key);
+    while (c->slot[i].key != 0) i = (i + 1) & (DEDUP_SLOTS - 1);
+    c->slot[i].key     = key;
+    c->slot[i].seen_ns = now;
+    return 0;
+}
+
+#ifndef LISTENER_NO_MAIN
+static void dedup_dump(FILE *f, const struct dedup_cache *c)
+{
+    fprintf(f, "Duplicates: %llu suppressed, %llu new, %llu evicted, "
+               "%u/%d remembered\n",
+            (unsigned long long)c->hits, (unsigned long long)c->misses,
+            (unsigned long long)c->evictions, c->count, DEDUP_ENTRIES);
+}
+#endif /* LISTENER_NO_MAIN */
+
+/* ================================================================== */
+/*  Worked-multiplier index                                             */
+/*                                                                      */
+/*  Every multiplier value seen on a new contact, per band x mode x   */
+/*  mult slot, so the listener knows on its own what is new.  Bands   */
+/*  and modes are interned into small IDs the first time they appear. */
+/*  Values (upper-cased, up to MULT_VALUE_MAX bytes) live inline in a */
+/*  linear-probing hash table, kept at most three quarters full, and  */
+/*  per band x mode x slot totals are kept alongside so a total is a  */
+/*  single load.  Fixed size, no pointers; receive thread only.       */
+/* ================================================================== */
+#define MULT_BANDS      32       /* distinct <band> values             */
+#define MULT_MODES      16       /* distinct <mode> values             */
+#define MULT_NAME_MAX   8
+#define MULT_VALUE_MAX  22
+#define MULT_SLOTS      16384    /* power of two                       */
+#define MULT_LIMIT      (MULT_SLOTS / 4 * 3)
+
+struct mult_entry {
+    uint32_t hash;               /* 0 = empty                          */
+    uint8_t  band, mode, slot;   /* slot: 0..2 for mult1..mult3        */
+    uint8_t  len;
+    char     value[MULT_VALUE_MAX + 2];
+};
+
+struct mult_index {
+    uint32_t          count;
+    uint32_t          full;      /* values not stored: table full      */
+    uint8_t           nbands, nmodes;
+    char              band[MULT_BANDS][MULT_NAME_MAX];
+    char              mode[MULT_MODES][MULT_NAME_MAX];
+    uint16_t          total[MULT_BANDS][MULT_MODES][3];
+    struct mult_entry slot[MULT_SLOTS];
+};
+
+/* ID for a band or mode name, adding it if new.  Names that do not fit
+   share the last ID. */
+static uint8_t mult_intern(char (*names)[MULT_NAME_MAX], uint8_t *n,
+                           unsigned int max, const struct xml_slice *s)
+{
+    size_t len = s->len < MULT_NAME_MAX - 1 ? s->len : MULT_NAME_MAX - 1;
+    for (unsigned int i = 0; i < *n; i++)
+        if (strncasecmp(names[i], s->p, len) == 0 && names[i][len] == '\0')
+            return (uint8_t)i;
+    if (*n == max) return (uint8_t)(max - 1);
+    for (size_t i = 0; i < len; i++)
+        names[*n][i] = (char)toupper((unsigned char)s->p[i]);
+    names[*n][len] = '\0';
+    return (*n)++;
+}
+
+/* Add one value.  Returns 1 if it was not in the index before, 0 if
+   it was, -1 if it was not and the index is too full to take it. */
+static int mult_add(struct mult_index *m, uint8_t band, uint8_t mode,
+                    uint8_t slot, const struct xml_slice *v)
+{
+    char   value[MULT_VALUE_MAX];
+    size_t len = v->len < MULT_VALUE_MAX ? v->len : MULT_VALUE_MAX;
+    uint32_t h = 2166136261u ^ ((uint32_t)band << 16 | mode << 8 | slot);
+    for (size_t i = 0; i < len; i++) {
+        value[i] = (char)toupper((unsigned char)v->p[i]);
+        h = (h ^ (unsigned char)value[i]) * 16777619u;
+    }
+    if (h == 0) h = 1;
+
+    uint32_t i = h & (MULT_SLOTS - 1);
+    for (; m->slot[i].hash != 0; i = (i + 1) & (MULT_SLOTS - 1)) {
+        const struct mult_entry *e = &m->slot[i];
+        if (e->hash == h && e->band == band && e->mode == mode &&
+            e->slot == slot && e->len == len &&
+            memcmp(e->value, value, len) == 0)
+            return 0;
+    }
+    if (m->count >= MULT_LIMIT) {
+        static int warned;           /* once per run                   */
+        m->full++;
+        if (!warned++)
+            fprintf(stderr, "Warning: mult index full (%u values); new "
+                            "values are not indexed and trigger = local "
+                            "goes by the logger's mult flags for them\n",
+                    m->count);
+        return -1;
+    }
+
+    struct mult_entry *e = &m->slot[i];
+    e->hash = h;
+    e->band = band;
+    e->mode = mode;
+    e->slot = slot;
+    e->len  = (uint8_t)len;
+    memcpy(e->value, value, len);
+    m->count++;
+    m->total[band][mode][slot]++;
+    return 1;
+}
+
+/* Index a contact's mult1..mult3.  Returns the slots whose value was
+   new, bit 0 = mult1; *full gets those that could not be indexed. */
+static unsigned mult_index_contact(struct mult_index *m,
+                                   const struct xml_fields *fl,
+                                   unsigned *full)
+{
+    uint8_t band = mult_intern(m->band, &m->nbands, MULT_BANDS,
+                               &fl->f[FLD_BAND]);
+    uint8_t mode = mult_intern(m->mode, &m->nmodes, MULT_MODES,
+                               &fl->f[FLD_MODE]);
+    unsigned fresh = 0;
+    *full = 0;
+    for (int s = 0; s < 3; s++) {
+        const struct xml_slice *v = &fl->f[FLD_MULT1 + s];
+        int rc = v->len ? mult_add(m, band, mode, (uint8_t)s, v) : 0;
+        if (rc > 0) fresh |= 1u << s;
+        if (rc < 0) *full |= 1u << s;
+    }
+    return fresh;
+}
+
+#ifndef LISTENER_NO_MAIN
+/* Distinct values in 'slot' over all bands and modes of the index. */
+static unsigned int mult_total(const struct mult_index *m, int slot)
+{
+    unsigned int n = 0;
+    for (int b = 0; b < m->nbands; b++)
+        for (int md = 0; md < m->nmodes; md++)
+            n += m->total[b][md][slot];
+    return n;
+}
+
+static void mult_dump(FILE *f, const struct mult_index *m)
+{
+    if (m->count == 0) return;
+    fprintf(f, "Mults worked        mult1  mult2  mult3\n");
+    for (int b = 0; b < m->nbands; b++)
+        for (int md = 0; md < m->nmodes; md++) {
+            const uint16_t *t = m->total[b][md];
+            if (t[0] + t[1] + t[2] == 0) continue;
+            fprintf(f, "  %-6s %-8s %8u %6u %6u\n",
+                    m->band[b], m->mode[md], t[0], t[1], t[2]);
+        }
+    fprintf(f, "  total           %8u %6u %6u\n",
+            mult_total(m, 0), mult_total(m, 1), mult_total(m, 2));
+    if (m->full)
+        fprintf(f, "  (%u values not indexed: index full)\n", m->full);
+}
+#endif /* LISTENER_NO_MAIN */
+
+/* ================================================================== */
+/*  Persistent state                                                    */
+/*                                                                      */
+/*  The dedup cache, the mult index and a few counters live in one   */
+/*  fixed-layout struct.  With a state file it is mmap()ed MAP_SHARED */
+/*  and updated in place, so a restart maps it and is warm at once;   */
+/*  the kernel writes dirty pages back, also if the process dies.     */
+/*  The header records the version and the sizes the layout depends  */
+/*  on; a file that does not match is started over.  Without a state */
+/*  file (and for -r replays) the same struct lives in memory only.   */
+/* ================================================================== */
+#define STATE_MAGIC    "MBSTATE"
+#define STATE_VERSION  1
+
+struct state_stats {
+    uint64_t starts;             /* times the file has been mapped     */
+    uint64_t contacts;           /* <contactinfo> datagrams            */
+    uint64_t bells;              /* triggers queued for the scheduler  */
+};
+
+struct state_file {
+    char               magic[8];
+    uint32_t           version;
+    uint32_t           size;     /* sizeof(struct state_file)          */
+    uint32_t           dedup_entries, mult_slots;
+    uint32_t           clean;    /* 1 = closed by state_close()        */
+    uint32_t           pad;
+    uint64_t           created_ns, closed_ns;
+    struct state_stats stats;
+    struct dedup_cache dedup;
+    struct mult_index  mults;
+};
+
+static struct state_file  g_state_mem;
+static struct state_file *g_state = &g_state_mem;
+#ifndef LISTENER_NO_MAIN
+static int                g_state_fd = -1;
+
+static void state_init(struct state_file *s)
+{
+    memset(s, 0, sizeof(*s));
+    memcpy(s->magic, STATE_MAGIC, sizeof(s->magic));
+    s->version       = STATE_VERSION;
+    s->size          = sizeof(*s);
+    s->dedup_entries = DEDUP_ENTRIES;
+    s->mult_slots    = MULT_SLOTS;
+    s->created_ns    = now_ns();
+}
+
+/* The dedup table holds exactly the ring's keys, each where a probe
+   from its home slot finds it, with room to spare */
+static int state_dedup_ok(struct dedup_cache *c)
+{
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < DEDUP_SLOTS; i++) {
+        uint64_t key = c->slot[i].key;
+        if (key == 0) continue;
+        used++;
+        if (used > DEDUP_ENTRIES) return 0;      /* no empty slot ahead */
+    }
+    if (used != c->count) return 0;
+    for (uint32_t i = 0; i < DEDUP_SLOTS; i++)
+        if (c->slot[i].key && dedup_find(c, c->slot[i].key) != &c->slot[i])
+            return 0;
+    for (uint32_t n = 0; n < c->count; n++) {
+        uint64_t key = c->ring[(c->head + n) & (DEDUP_ENTRIES - 1)];
+        if (key == 0 || !dedup_find(c, key)) return 0;
+    }
+    return 1;
+}
+
+/* Every mult entry is in range and reachable from its home slot, and
+   the count and per band x mode x slot totals agree with the table */
+static int state_mults_ok(const struct mult_index *m)
+{
+    static uint16_t total[MULT_BANDS][MULT_MODES][3];
+    uint32_t used = 0;
+    memset(total, 0, sizeof(total));
+    for (uint32_t i = 0; i < MULT_SLOTS; i++) {
+        const struct mult_entry *e = &m->slot[i];
+        if (e->hash == 0) continue;
+        if (++used > MULT_LIMIT) return 0;
+        if (e->band >= m->nbands || e->mode >= m->nmodes || e->slot > 2 ||
+            e->len > MULT_VALUE_MAX)
+            return 0;
+        for (uint32_t j = e->hash & (MULT_SLOTS - 1); j != i;
+             j = (j + 1) & (MULT_SLOTS - 1))
+            if (m->slot[j].hash == 0) return 0;
+        total[e->band][e->mode][e->slot]++;
+    }
+    if (used != m->count) return 0;
+    return memcmp(total, m->total, sizeof(total)) == 0;
+}
+
+/* Header matches this build, the indices are in range and the tables
+   are consistent.  The tables are checked in full on every start,
+   cleanly closed or not: a probe of a table with no empty slot would
+   never end. */
+static int state_valid(struct state_file *s)
+{
+    if (memcmp(s->magic, STATE_MAGIC, sizeof(s->magic)) != 0 ||
+        s->version != STATE_VERSION || s->size != sizeof(*s) ||
+        s->dedup_entries != DEDUP_ENTRIES || s->mult_slots != MULT_SLOTS)
+        return 0;
+    if (s->dedup.head >= DEDUP_ENTRIES || s->dedup.count > DEDUP_ENTRIES)
+        return 0;
+    const struct mult_index *m = &s->mults;
+    if (m->count > MULT_LIMIT || m->nbands > MULT_BANDS ||
+        m->nmodes > MULT_MODES)
+        return 0;
+    for (int i = 0; i < m->nbands; i++)
+        if (!memchr(m->band[i], '\0', MULT_NAME_MAX)) return 0;
+    for (int i = 0; i < m->nmodes; i++)
+        if (!memchr(m->mode[i], '\0', MULT_NAME_MAX)) return 0;
+    return state_dedup_ok(&s->dedup) && state_mults_ok(m);
+}
+
+/* Map 'path' as the live state.  Returns 1 if it held earlier state,
+   0 if it was started over, -1 on error (state stays in memory). */
+static int state_open(const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) { perror(path); return -1; }
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+        fprintf(stderr, "%s: in use by another listener\n", path);
+        close(fd);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) { perror(path); close(fd); return -1; }
+    int warm = st.st_size == (off_t)sizeof(struct state_file);
+    if (!warm && (ftruncate(fd, 0) < 0 ||
+                  ftruncate(fd, sizeof(struct state_file)) < 0)) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    struct state_file *s = mmap(NULL, sizeof(*s), PROT_READ | PROT_WRITE,
+                                MAP_SHARED, fd, 0);
+    if (s == MAP_FAILED) { perror("mmap"); close(fd); return -1; }
+
+    if (warm && !state_valid(s)) warm = 0;
+    if (!warm) {
+        if (st.st_size)
+            fprintf(stderr, "%s: other version or damaged, "
+                    "starting over\n", path);
+        state_init(s);
+    }
+    g_state    = s;
+    g_state_fd = fd;
+    return warm;
+}
+
+/* Mark the state file cleanly closed and write it out */
+static void state_close(void)
+{
+    if (g_state_fd < 0) return;
+    g_state->clean     = 1;
+    g_state->closed_ns = now_ns();
+    if (msync(g_state, sizeof(*g_state), MS_SYNC) < 0)
+        perror("msync");
+    munmap(g_state, sizeof(*g_state));
+    close(g_state_fd);
+    g_state    = &g_state_mem;
+    g_state_fd = -1;
+}
+#endif /* LISTENER_NO_MAIN */
+
+/* ================================================================== */
+/*  Log thread                                                          */
+/*                                                                      */
+/*  The per-datagram console line is formatted and written by a       */
+/*  background thread.  process_datagram() only copies the fields it  */
+/*  wants into a fixed-size record and pushes it onto an SPSC ring;   */
+/*  inet_ntop(), localtime_r(), strftime(), printf() and the flush    */
+/*  (which can stall for a long time on an SD-card journal) all       */
+/*  happen off the receive path.  When the ring is full the record is */
+/*  dropped and counted rather than blocking the receive thread.      */
+/* ================================================================== */
+#define LOG_QUEUE_LEN   256      /* records (power of two)             */
+#define LOG_FIELD_MAX   15       /* longer field values are truncated  */
+
+enum { LOG_RING = 1, LOG_DUP = 2, LOG_REPLACE = 4, LOG_DELETE = 8 };
+
+static const int log_fields[] = {
+    FLD_CALL, FLD_BAND, FLD_MODE, FLD_MULT1, FLD_MULT2, FLD_MULT3, FLD_NEWQSO
+};
+#define LOG_FIELDS  (int)(sizeof(log_fields) / sizeof(log_fields[0]))
+
+struct log_record {
+    uint64_t rx_ns;              /* CLOCK_REALTIME receive time        */
+    uint8_t  addr[16];           /* source, network order              */
+    uint8_t  family;             /* AF_INET or AF_INET6                */
+    uint8_t  flags;              /* LOG_RING, LOG_DUP, ...             */
+    uint8_t  len[LOG_FIELDS];
+    char     text[LOG_FIELDS][LOG_FIELD_MAX];
+};
+
+static struct spsc_ring   g_log_ring;
+static sem_t              g_log_wake;
+static unsigned long long g_log_dropped;
+#ifndef LISTENER_NO_MAIN
+static atomic_int         g_log_stop;
+static pthread_t          g_log_tid;
+static int                g_log_running;
+static FILE              *g_log_out;      /* stdout unless -l           */
+#endif /* LISTENER_NO_MAIN */
+
+/* Receive-thread side.  Never blocks. */
+static void log_submit(uint64_t rx_ns, const struct sockaddr_storage *src,
+                       const struct xml_fields *fl, int flags)
+{
+    struct log_record rec;
+    rec.rx_ns  = rx_ns;
+    rec.family = (uint8_t)src->ss_family;
+    if (src->ss_family == AF_INET6)
+        memcpy(rec.addr, &((const struct sockaddr_in6 *)src)->sin6_addr, 16);
+    else
+        memcpy(rec.addr, &((const struct sockaddr_in *)src)->sin_addr, 4);
+    rec.flags = (uint8_t)flags;
+    for (int i = 0; i < LOG_FIELDS; i++) {
+        const struct xml_slice *v = &fl->f[log_fields[i]];
+        size_t n = v->len < LOG_FIELD_MAX ? v->len : LOG_FIELD_MAX;
+        memcpy(rec.text[i], v->p, n);
+        rec.len[i] = (uint8_t)n;
+    }
+    if (spsc_push(&g_log_ring, &rec) < 0) {
+        g_log_dropped++;
+        return;
+    }
+    sem_post(&g_log_wake);
+}
+
+#define LOG_ARG(r, i) \
+    (int)((r)->len[i] ? (r)->len[i] : 1), ((r)->len[i] ? (r)->text[i] : "-")
+
+#ifndef LISTENER_NO_MAIN
+static void log_format(FILE *f, const struct log_record *r)
+{
+    /* localtime_r(): glibc's localtime() re-reads the time zone and
+       strdup()s it on every call when TZ is unset.  Consecutive
+       records usually share a second, so reuse the last string. */
+    static time_t last_sec = -1;
+    static char   stamp[32];
+    time_t sec = (time_t)(r->rx_ns / 1000000000u);
+    if (sec != last_sec) {
+        struct tm t;
+        localtime_r(&sec, &t);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &t);
+        last_sec = sec;
+    }
+
+    char addr[INET6_ADDRSTRLEN];
+    inet_ntop(r->family == AF_INET6 ? AF_INET6 : AF_INET, r->addr,
+              addr, sizeof(addr));
+
+    fprintf(f, "[%s] PKT from %-15s call=%-8.*s band=%-3.*s mode=%-3.*s mult1=%-2.*s  mult2=%-2.*s  mult3=%-2.*s newqso=%-5.*s%s\n",
+            stamp, addr,
+            LOG_ARG(r, 0), LOG_ARG(r, 1), LOG_ARG(r, 2), LOG_ARG(r, 3),
+            LOG_ARG(r, 4), LOG_ARG(r, 5), LOG_ARG(r, 6),
+            (r->flags & LOG_DELETE)  ? "  (deleted)"              :
+            (r->flags & LOG_REPLACE) ? "  (edited, no sound)"     :
+            (r->flags & LOG_DUP)     ? "  (duplicate, no sound)"  :
+            (r->flags & LOG_RING)    ? "  *** MULT → SOUND ***"   : "");
+}
+
+static void *log_thread(void *arg)
+{
+    (void)arg;
+    struct log_record rec;
+    for (;;) {
+        int n = 0;
+        while (spsc_pop(&g_log_ring, &rec) == 0) {
+            log_format(g_log_out, &rec);
+            n++;
+        }
+        if (n) fflush(g_log_out);          /* once per drained batch */
+        else if (atomic_load(&g_log_stop)) break;
+        else
+            while (sem_wait(&g_log_wake) < 0 && errno == EINTR)
+                ;
+    }
+    return NULL;
+}
+
+/* Log to 'path' (appended), or stdout if NULL. */
+static int log_start(const char *path)
+{
+    g_log_out = stdout;
+    if (path) {
+        g_log_out = fopen(path, "a");
+        if (!g_log_out) { perror(path); return -1; }
+        setvbuf(g_log_out, NULL, _IOFBF, 65536);
+    }
+    if (spsc_init(&g_log_ring, LOG_QUEUE_LEN, sizeof(struct log_record)) < 0 ||
+        sem_init(&g_log_wake, 0, 0) < 0) {
+        perror("log ring");
+        return -1;
+    }
+    atomic_init(&g_log_stop, 0);
+    if (thread_start(&g_log_tid, log_thread, NULL) < 0) {
+        perror("log thread");
+        return -1;
+    }
+    g_log_running = 1;
+    return 0;
+}
+
+/* Write out everything queued, then join the thread.  Idempotent. */
+static void log_stop(void)
+{
+    if (!g_log_running) return;
+    g_log_running = 0;
+    atomic_store(&g_log_stop, 1);
+    sem_post(&g_log_wake);
+    pthread_join(g_log_tid, NULL);
+    if (g_log_out != stdout) fclose(g_log_out);
+    free(g_log_ring.slots);
+    sem_destroy(&g_log_wake);
+}
+#endif /* LISTENER_NO_MAIN */
+
+/* ================================================================== */
+/*  Message types                                                       */
+/*                                                                      */
+/*  DXLog and N1MM send several kinds of datagram to the same port,   */
+/*  told apart by the root element.  msg_root() looks only at the     */
+/*  first ROOT_SCAN bytes: the first '<' followed by a letter (past   */
+/*  the <?xml ...?> declaration) opens the root, whose name runs to   */
+/*  '>', '/' or white space (<spot_list> is not <spot>).  The name is */
+/*  looked up in a perfect hash of the known roots, so a datagram of  */
+/*  a kind nobody reads costs a few dozen byte compares whatever its  */
+/*  size.  The hash is the name's length plus its first letter, low   */
+/*  3 bits; msg_hash[] is built with designated initializers, so two  */
+/*  roots in one slot trip -Woverride-init (-Wextra).                 */
+/* ================================================================== */
+#define ROOT_SCAN      96           /* bytes searched for the root     */
+#define ROOT_NAME_MAX  14           /* longest known root name          */
+#define ROOT_HASH(len, c)  ((unsigned)((len) + ((c) | 0x20)) & 7)
+
+enum msg_type {
+    MSG_NONE,                       /* no root element we know         */
+    MSG_CONTACT,                    /* contactinfo: a contact logged   */
+    MSG_REPLACE,                    /* contactreplace: one edited      */
+    MSG_DELETE,                     /* contactdelete                   */
+    MSG_RADIO,                      /* RadioInfo                       */
+    MSG_SPOT,                       /* spot                            */
+    MSG_SCORE,                      /* dynamicresults                  */
+    MSG_TYPES
+};
+
+static const struct {
+    const char *root;
+    size_t      len;
+} msg_roots[MSG_TYPES] = {
+    [MSG_NONE]    = { "other",          0 },
+    [MSG_CONTACT] = { "contactinfo",    11 },
+    [MSG_REPLACE] = { "contactreplace", 14 },
+    [MSG_DELETE]  = { "contactdelete",  13 },
+    [MSG_RADIO]   = { "RadioInfo",      9 },
+    [MSG_SPOT]    = { "spot",           4 },
+    [MSG_SCORE]   = { "dynamicresults", 14 },
+};
+
+static const uint8_t msg_hash[8] = {
+    [ROOT_HASH(11, 'c')] = MSG_CONTACT,
+    [ROOT_HASH(14, 'c')] = MSG_REPLACE,
+    [ROOT_HASH(13, 'c')] = MSG_DELETE,
+    [ROOT_HASH(9,  'r')] = MSG_RADIO,
+    [ROOT_HASH(4,  's')] = MSG_SPOT,
+    [ROOT_HASH(14, 'd')] = MSG_SCORE,
+};
+
+static int is_xml_letter(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/* What may follow the root's name; the socket filter tests the same */
+static const char root_ends[] = { '>', '/', ' ', '\t', '\r', '\n' };
+#define ROOT_ENDS  (int)sizeof(root_ends)
+
+static int is_root_end(char c)
+{
+    return c != '\0' && memchr(root_ends, c, ROOT_ENDS) != NULL;
+}
+
+/* The datagram's root element, case-insensitive; MSG_NONE if it is
+   not one of msg_roots[] or does not start within ROOT_SCAN bytes */
+static enum msg_type msg_root(const char *buf, size_t len)
+{
+    size_t scan = len < ROOT_SCAN ? len : ROOT_SCAN;
+    const char *p = memchr(buf, '<', scan);
+    while (p && p + 1 < buf + len && !is_xml_letter(p[1]))
+        p = memchr(p + 1, '<', scan - (size_t)(p + 1 - buf));
+    if (!p || p + 1 >= buf + len) return MSG_NONE;
+
+    const char *name = p + 1, *end = buf + len;
+    size_t      n    = 1;
+    while (n <= ROOT_NAME_MAX && name + n < end && is_xml_letter(name[n]))
+        n++;
+    if (n > ROOT_NAME_MAX || name + n == end || !is_root_end(name[n]))
+        return MSG_NONE;
+
+    enum msg_type t = msg_hash[ROOT_HASH(n, name[0])];
+    if (msg_roots[t].len != n ||
+        strncasecmp(name, msg_roots[t].root, n) != 0)
+        return MSG_NONE;
+    return t;
+}
+
+/* ================================================================== */
+/*  Process one UDP datagram                                            */
+/*                                                                      */
+/*  msg_root() picks the handler.  The contact messages are parsed    */
+/*  into fields and passed on; the rest have no reader yet and are    */
+/*  only counted by type.                                              */
+/* ================================================================== */
+/* Set by -L: use the original per-field xml_get_field() rescans. */
+static int g_legacy_parser;
+/* Set by -q: no per-datagram console line. */
+static int g_quiet;
+
+/* Parse stage: the message type and, for the contact messages, their
+   fields as slices into buf */
+static enum msg_type msg_parse(const char *buf, size_t len,
+                               struct xml_fields *fl)
+{
+    /* Parse in place: every field is a slice into the receive buffer */
+    if (g_legacy_parser) {
+        /* <contactinfo> anywhere, then one full rescan per field */
+        if (!find_tag(buf, len, "<contactinfo>", 13)) return MSG_NONE;
+        memset(fl, 0, sizeof(*fl));
+        for (int i = 0; i < FLD_COUNT; i++)
+            if (xml_get_field(buf, len, xml_wanted[i].tag, &fl->f[i]))
+                fl->found |= 1u << i;
+        return MSG_CONTACT;
+    }
+    enum msg_type t = msg_root(buf, len);
+    if (t == MSG_CONTACT || t == MSG_REPLACE || t == MSG_DELETE)
+        xml_scan_fields(buf, len, fl);
+    return t;
+}
+
+/* The handlers below are the trigger stage: mult index, dedup, bell
+   and log line.  Always on one thread: the receive loop, or with
+   workers the main thread's. */
+typedef void (*msg_handler)(const struct xml_fields *fl,
+                            const struct sockaddr_storage *src,
+                            uint64_t rx_ns, uint64_t parsed_ns);
+
+/* <contactinfo>: a new contact, which may ring */
+static void contact_trigger(const struct xml_fields *fl,
+                            const struct sockaddr_storage *src,
+                            uint64_t rx_ns, uint64_t parsed_ns)
+{
+    lat_record(LAT_RX_PARSED, rx_ns, parsed_ns);
+    g_state->stats.contacts++;
+
+    /* ---- Trigger: all three conditions must be true ---------------- */
+    unsigned mults = (fl->f[FLD_MULT1].len ? 1u : 0) |
+                     (fl->f[FLD_MULT2].len ? 2u : 0) |
+                     (fl->f[FLD_MULT3].len ? 4u : 0);
+    int is_new = xml_slice_eq(&fl->f[FLD_NEWQSO], "true");
+
+    /* With trigger = local, only a value the index has not seen on
+       this band and mode rings, whatever the sending station thinks */
+    int ring = mults && is_new;
+    if (ring) {
+        unsigned full;
+        unsigned fresh = mult_index_contact(&g_state->mults, fl, &full);
+        /* A slot the full index could not check keeps the logger's
+           flag rather than passing as new */
+        if (atomic_load_explicit(&g_trigger_local, memory_order_relaxed))
+            mults = fresh | (mults & full);
+        ring = mults != 0;
+    }
+    int dup  = ring && dedup_check(&g_state->dedup, dedup_key(fl), rx_ns);
+    if (ring && !dup) {
+        /* Only bells actually queued are timed; duplicates would
+           skew the histogram */
+        uint64_t trigger_ns = now_ns();
+        if (trigger_sound(rx_ns, trigger_ns, mults) == 0) {
+            lat_record(LAT_PARSED_TRIGGER, parsed_ns, trigger_ns);
+            g_state->stats.bells++;
+        }
+    }
+
+    if (!g_quiet)
+        log_submit(rx_ns, src, fl,
+                   (ring ? LOG_RING : 0) | (dup ? LOG_DUP : 0));
+}
+
+/* <contactreplace>: a contact edited after the fact.  A mult value
+   it now carries goes into the index, so trigger = local will not
+   ring for it later; the edit itself never rings. */
+static void contact_replace(const struct xml_fields *fl,
+                            const struct sockaddr_storage *src,
+                            uint64_t rx_ns, uint64_t parsed_ns)
+{
+    unsigned full;
+    (void)parsed_ns;
+    if (fl->f[FLD_MULT1].len || fl->f[FLD_MULT2].len || fl->f[FLD_MULT3].len)
+        mult_index_contact(&g_state->mults, fl, &full);
+    if (!g_quiet)
+        log_submit(rx_ns, src, fl, LOG_REPLACE);
+}
+
+/* <contactdelete>: only logged; a worked mult stays worked */
+static void contact_delete(const struct xml_fields *fl,
+                           const struct sockaddr_storage *src,
+                           uint64_t rx_ns, uint64_t parsed_ns)
+{
+    (void)parsed_ns;
+    if (!g_quiet)
+        log_submit(rx_ns, src, fl, LOG_DELETE);
+}
+
+/* NULL: counted, nothing else */
+static const msg_handler msg_handlers[MSG_TYPES] = {
+    [MSG_CONTACT] = contact_trigger,
+    [MSG_REPLACE] = contact_replace,
+    [MSG_DELETE]  = contact_delete,
+};
+
+/* Returns the message type, MSG_NONE for anything not recognised */
+static enum msg_type process_datagram(const char *buf, size_t len,
+                                      const struct sockaddr_storage *src,
+                                      const struct timespec *rx)
+{
+    struct xml_fields fl;
+    enum msg_type     t = msg_parse(buf, len, &fl);
+    if (msg_handlers[t])
+        msg_handlers[t](&fl, src, ts_ns(rx), now_ns());
+    return t;
+}
+
+#ifndef LISTENER_NO_MAIN
+/* ================================================================== */
+/*  Parsed contact                                                      */
+/*                                                                      */
+/*  What a receive worker hands the trigger stage: the type of a      */
+/*  contact message and the fields it found, copied out of the        */
+/*  receive slot (which the next batch reuses) into one fixed-size    */
+/*  record for an SPSC ring.  Fields are kept as offsets so the       */
+/*  record can be copied freely.                                      */
+/* ================================================================== */
+#define CONTACT_ARENA  512          /* field bytes per contact; a
+                                       longer field is cut            */
+
+struct parsed_contact {
+    uint64_t                rx_ns, parsed_ns;
+    struct sockaddr_storage src;
+    enum msg_type           type;
+    unsigned int            found;
+    uint16_t                off[FLD_COUNT], len[FLD_COUNT];
+    char                    arena[CONTACT_ARENA];
+};
+
+static void contact_pack(struct parsed_contact *pc,
+                         const struct xml_fields *fl)
+{
+    size_t used = 0;
+    pc->found = fl->found;
+    for (int i = 0; i < FLD_COUNT; i++) {
+        size_t n = fl->f[i].len;
+        if (n > CONTACT_ARENA - used) n = CONTACT_ARENA - used;
+        if (n) memcpy(pc->arena + used, fl->f[i].p, n);
+        pc->off[i] = (uint16_t)used;
+        pc->len[i] = (uint16_t)n;
+        used += n;
+    }
+}
+
+/* Slices into pc->arena; valid as long as *pc is */
+static void contact_unpack(const struct parsed_contact *pc,
+                           struct xml_fields *fl)
+{
+    fl->found = pc->found;
+    for (int i = 0; i < FLD_COUNT; i++) {
+        fl->f[i].p   = pc->arena + pc->off[i];
+        fl->f[i].len = pc->len[i];
+    }
+}
+
+/* ================================================================== */
+/*  Batched receive ring                                                */
+/*                                                                      */
+/*  One pre-allocated slot (buffer + iovec + mmsghdr + source address) */
+/*  per datagram in a recvmmsg() batch.  Slots are reused on every     */
+/*  call; process_datagram() is done with a slot before the next call. */
+/* ================================================================== */
+/* cmsg space per slot: receive timestamp, kernel drop counter and
+   (workers only) destination address */
+#define RECV_CTRL_SIZE  (CMSG_SPACE(sizeof(struct timespec)) + \
+                         CMSG_SPACE(sizeof(uint32_t)) + \
+                         CMSG_SPACE(sizeof(struct in6_pktinfo)))
+
+struct recv_ring {
+    unsigned int        batch;
+    char               *bufs;       /* batch * RECV_SLOT_SIZE bytes   */
+    char               *ctrl;       /* batch * RECV_CTRL_SIZE bytes   */
+    struct iovec       *iovs;
+    struct mmsghdr     *msgs;
+    struct sockaddr_storage *srcs;
+    unsigned long long  syscalls;   /* receive calls that returned data */
+    unsigned long long  datagrams;
+};
+
+static int recv_ring_init(struct recv_ring *r, unsigned int batch)
+{
+    memset(r, 0, sizeof(*r));
+    r->batch = batch;
+    r->bufs  = malloc((size_t)batch * RECV_SLOT_SIZE);
+    r->iovs  = calloc(batch, sizeof(*r->iovs));
+    r->msgs  = calloc(batch, sizeof(*r->msgs));
+    r->srcs  = calloc(batch, sizeof(*r->srcs));
+    r->ctrl  = calloc(batch, RECV_CTRL_SIZE);
+    if (!r->bufs || !r->iovs || !r->msgs || !r->srcs || !r->ctrl) return -1;
+
+    for (unsigned int i = 0; i < batch; i++) {
+        r->iovs[i].iov_base = r->bufs + (size_t)i * RECV_SLOT_SIZE;
+        r->iovs[i].iov_len  = RECV_SLOT_SIZE - 1;
+        r->msgs[i].msg_hdr.msg_iov     = &r->iovs[i];
+        r->msgs[i].msg_hdr.msg_iovlen  = 1;
+        r->msgs[i].msg_hdr.msg_name    = &r->srcs[i];
+        r->msgs[i].msg_hdr.msg_namelen = sizeof(r->srcs[i]);
+        r->msgs[i].msg_hdr.msg_control    = r->ctrl + (size_t)i * RECV_CTRL_SIZE;
+        r->msgs[i].msg_hdr.msg_controllen = RECV_CTRL_SIZE;
+    }
+    return 0;
+}
+
+/* Reset the in/out fields the kernel overwrote on the last call */
+static void recv_ring_reset(struct recv_ring *r, unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++) {
+        r->msgs[i].msg_hdr.msg_namelen    = sizeof(r->srcs[i]);
+        r->msgs[i].msg_hdr.msg_controllen = RECV_CTRL_SIZE;
+        r->msgs[i].msg_len                = 0;
+    }
+}
+
+/* Kernel receive time (SO_TIMESTAMPNS) of a datagram, or now if the
+   kernel did not supply one.  Also picks up the socket's running count
+   of datagrams dropped for want of buffer space (SO_RXQ_OVFL).
+   Returns 1 for a datagram sent to a broadcast or multicast address;
+   only known on sockets that asked for IP_PKTINFO / IPV6_RECVPKTINFO. */
+static int recv_cmsg(struct msghdr *mh, struct timespec *ts,
+                     uint32_t *drops)
+{
+    int stamped = 0, group = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(mh); c; c = CMSG_NXTHDR(mh, c)) {
+        if (c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_PKTINFO) {
+            /* Sent to one of our addresses, the two are the same */
+            struct in_pktinfo pi;
+            memcpy(&pi, CMSG_DATA(c), sizeof(pi));
+            group = pi.ipi_addr.s_addr != pi.ipi_spec_dst.s_addr;
+        } else if (c->cmsg_level == IPPROTO_IPV6 &&
+                   c->cmsg_type == IPV6_PKTINFO) {
+            struct in6_pktinfo pi;
+            memcpy(&pi, CMSG_DATA(c), sizeof(pi));
+            group = IN6_IS_ADDR_MULTICAST(&pi.ipi6_addr);
+        }
+        if (c->cmsg_level != SOL_SOCKET) continue;
+        if (c->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(ts, CMSG_DATA(c), sizeof(*ts));
+            stamped = 1;
+        } else if (c->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(drops, CMSG_DATA(c), sizeof(*drops));
+        }
+    }
+    if (!stamped) clock_gettime(CLOCK_REALTIME, ts);
+    return group;
+}
+
+
+static void recv_ring_free(struct recv_ring *r)
+{
+    free(r->bufs);
+    free(r->iovs);
+    free(r->msgs);
+    free(r->srcs);
+    free(r->ctrl);
+}
+
+/* The receive loop reads signals from a signalfd; these handlers are
+   for the paths without one (-r replay) */
+static volatile sig_atomic_t g_stop;
+static volatile sig_atomic_t g_dump_stats;
+
+static void on_stop_signal(int sig)
+{
+    (void)sig;
+    g_stop = 1;
+}
+
+static void on_usr1_signal(int sig)
+{
+    (void)sig;
+    g_dump_stats = 1;
+}
+
+/* After SIGUSR1 outside the receive loop: what rx_signals() prints,
+   less the socket counts */
+static void dump_stats_poll(void)
+{
+    if (!g_dump_stats) return;
+    g_dump_stats = 0;
+    lat_dump(stdout);
+    dedup_dump(stdout, &g_state->dedup);
+    mult_dump(stdout, &g_state->mults);
+    fflush(stdout);
+}
+
+
+/* ================================================================== */
+/*  Capture and replay                                                  */
+/*                                                                      */
+/*  -w FILE appends every received datagram to FILE; -r FILE feeds a  */
+/*  capture back through process_datagram() instead of listening,     */
+/*  at the recorded pace scaled by -x N (0 = as fast as possible).    */
+/*                                                                      */
+/*  File layout (host byte order; both targets are little-endian):    */
+/*    struct cap_header, then per datagram a struct cap_record        */
+/*    followed by 'len' payload bytes.  Records are only ever          */
+/*    appended, so a capture can be extended across restarts.        */
+/* ================================================================== */
+#define CAP_MAGIC    "MBELLCAP"
+#define CAP_VERSION  1
+
+struct cap_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;        /* sizeof(struct cap_record)         */
+};
+
+struct cap_record {
+    uint64_t ts_ns;              /* kernel receive time, REALTIME     */
+    uint32_t len;                /* payload bytes that follow         */
+    uint16_t port;               /* source port, network order        */
+    uint8_t  family;             /* 4 or 6                            */
+    uint8_t  pad;
+    uint8_t  addr[16];           /* source address, network order     */
+};
+
+static FILE *g_capture;
+static char  g_capture_buf[1 << 16];
+
+static int capture_open(const char *path)
+{
+    g_capture = fopen(path, "ab");
+    if (!g_capture) { perror(path); return -1; }
+    setvbuf(g_capture, g_capture_buf, _IOFBF, sizeof(g_capture_buf));
+
+    struct stat st;
+    if (fstat(fileno(g_capture), &st) == 0 && st.st_size == 0) {
+        struct cap_header h = { .version     = CAP_VERSION,
+                                .record_size = sizeof(struct cap_record) };
+        memcpy(h.magic, CAP_MAGIC, sizeof(h.magic));
+        fwrite(&h, sizeof(h), 1, g_capture);
+    }
+    return 0;
+}
+
+static void capture_write(const struct timespec *rx,
+                          const struct sockaddr_storage *src,
+                          const char *buf, size_t len)
+{
+    struct cap_record r;
+    memset(&r, 0, sizeof(r));
+    r.ts_ns  = ts_ns(rx);
+    r.len    = (uint32_t)len;
+    if (src->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *a = (const struct sockaddr_in6 *)src;
+        r.port   = a->sin6_port;
+        r.family = 6;
+        memcpy(r.addr, &a->sin6_addr, sizeof(a->sin6_addr));
+    } else {
+        const struct sockaddr_in *a = (const struct sockaddr_in *)src;
+        r.port   = a->sin_port;
+        r.family = 4;
+        memcpy(r.addr, &a->sin_addr, sizeof(a->sin_addr));
+    }
+    /* Workers write concurrently; keep header and payload together */
+    flockfile(g_capture);
+    fwrite_unlocked(&r, sizeof(r), 1, g_capture);
+    fwrite_unlocked(buf, 1, len, g_capture);
+    funlockfile(g_capture);
+}
+
+/* Once per receive batch, so a crash loses at most one batch */
+static void capture_flush(void)
+{
+    if (g_capture) fflush(g_capture);
+}
+
+static void capture_close(void)
+{
+    if (g_capture) fclose(g_capture);
+    g_capture = NULL;
+}
+
+static double elapsed_s(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - since->tv_sec) +
+           (double)(now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static int replay_file(const char *path, double speed)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { perror(path); return -1; }
+    struct stat st;
+    if (fstat(fd, &st) < 0) { perror(path); close(fd); return -1; }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(struct cap_header)) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        close(fd);
+        return -1;
+    }
+    const unsigned char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { perror("mmap"); return -1; }
+
+    struct cap_header h;
+    memcpy(&h, map, sizeof(h));
+    if (memcmp(h.magic, CAP_MAGIC, sizeof(h.magic)) != 0 ||
+        h.version != CAP_VERSION ||
+        h.record_size != sizeof(struct cap_record)) {
+        fprintf(stderr, "%s: not a version %d capture file\n",
+                path, CAP_VERSION);
+        munmap((void *)map, size);
+        return -1;
+    }
+
+    printf("Replaying %s at %s …\n\n", path,
+           speed > 0 ? (speed == 1.0 ? "recorded pace" : "scaled pace")
+                     : "full speed");
+    fflush(stdout);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t start_ns = ts_ns(&start);
+    uint64_t first_ts = 0;
+    unsigned long long count = 0, bytes = 0;
+
+    size_t off = sizeof(h);
+    while (!g_stop && off + sizeof(struct cap_record) <= size) {
+        dump_stats_poll();
+        struct cap_record r;
+        memcpy(&r, map + off, sizeof(r));
+        off += sizeof(r);
+        if (r.len > size - off) {
+            fprintf(stderr, "%s: truncated record at offset %zu\n",
+                    path, off - sizeof(r));
+            break;
+        }
+        const char *payload = (const char *)map + off;
+        off += r.len;
+
+        if (count == 0) first_ts = r.ts_ns;
+        if (speed > 0 && r.ts_ns > first_ts) {
+            uint64_t due = start_ns +
+                           (uint64_t)((double)(r.ts_ns - first_ts) / speed);
+            struct timespec ts = { .tv_sec  = (time_t)(due / 1000000000ull),
+                                   .tv_nsec = (long)(due % 1000000000ull) };
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                   &ts, NULL) == EINTR && !g_stop)
+                dump_stats_poll();
+        }
+
+        struct sockaddr_storage src;
+        memset(&src, 0, sizeof(src));
+        if (r.family == 6) {
+            struct sockaddr_in6 *a = (struct sockaddr_in6 *)&src;
+            a->sin6_family = AF_INET6;
+            a->sin6_port   = r.port;
+            memcpy(&a->sin6_addr, r.addr, sizeof(a->sin6_addr));
+        } else {
+            struct sockaddr_in *a = (struct sockaddr_in *)&src;
+            a->sin_family = AF_INET;
+            a->sin_port   = r.port;
+            memcpy(&a->sin_addr, r.addr, sizeof(a->sin_addr));
+        }
+
+        /* Stamp with the injection time so the latency histograms
+           measure this run, not the original capture. */
+        struct timespec rx;
+        clock_gettime(CLOCK_REALTIME, &rx);
+        process_datagram(payload, r.len, &src, &rx);
+        count++;
+        bytes += r.len;
+    }
+
+    double secs = elapsed_s(&start);
+    log_stop();                  /* summary after the last packet line */
+    printf("\nReplayed %llu datagrams, %llu bytes in %.3f s "
+           "(%.0f datagrams/s, %.1f MB/s)\n",
+           count, bytes, secs,
+           secs > 0 ? (double)count / secs : 0.0,
+           secs > 0 ? (double)bytes / secs / 1e6 : 0.0);
+    munmap((void *)map, size);
+    return 0;
+}
+
+/* ================================================================== */
+/*  Main                                                                 */
+/*                                                                      */
+/*  bench.c includes this file with LISTENER_NO_MAIN defined to       */
+/*  reuse the parsing and trigger code.  Whatever only main()         */
+/*  reaches (threads, sockets, sounds, reports) is under #ifndef      */
+/*  LISTENER_NO_MAIN where it stands, so the bench build still        */
+/*  warns about unused functions.                                     */
+/* ================================================================== */
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-b batch] [-L] [-S] [-F] [-q] [-l file] [-w file] "
+            "[-r file [-x speed]] [-C file] [-c ms] [-m strikes] "
+            "[-R bells] [-s file] [-W workers] [-U]\n"
+            "  -b N   datagrams per recvmmsg() call, 1..%d "
+            "(default %d, 1 = recvmsg)\n"
+            "  -L     legacy parser (one document rescan per field)\n"
+            "  -S     scalar <contactinfo> scan for -L (no SSE2/NEON)\n"
+            "  -F     use the fork backend (aplay per bell) regardless of\n"
+            "         the probe\n"
+            "  -q     quiet: do not print a line per datagram\n"
+            "  -l F   append the per-datagram lines to F instead of "
+            "stdout\n"
+            "  -w F   append every received datagram to capture file F\n"
+            "  -r F   replay capture file F instead of listening\n"
+            "  -x N   replay at N times the recorded pace, 0 = as fast "
+            "as possible\n"
+            "  -C F   config file (default %s), re-read when it changes\n"
+            "  -c MS  ring triggers within MS of a bell as one bell "
+            "(default %d, 0 = off)\n"
+            "  -m N   strike a coalesced bell up to N times (default %d)\n"
+            "  -R N   at most N bells per minute (default %d, 0 = no "
+            "limit)\n"
+            "  -s F   keep dedup cache, mult index and counters in F "
+            "(default %s,\n"
+            "         \"\" = in memory only)\n"
+            "  -W N   receive and parse on N pinned worker threads, "
+            "0..%d\n"
+            "         (default %d = on the main thread); broadcasts all "
+            "go to worker 0\n"
+            "  -U     receive through io_uring (multishot recvmsg), "
+            "if the kernel can\n",
+            prog, RECV_BATCH_MAX, RECV_BATCH, CONFIG_FILE,
+            COALESCE_MS, MULTI_RING_MAX, BELLS_PER_MIN, STATE_FILE,
+            WORKER_MAX, RECV_WORKERS);
+}
+
+/* ================================================================== */
+/*  Socket filter                                                       */
+/*                                                                      */
+/*  filter = on: a classic BPF program on every socket lets the kernel */
+/*  drop what the listener would ignore anyway, before it is queued,  */
+/*  copied out or wakes anything.  Built once at startup from the     */
+/*  config, one program per address family:                          */
+/*    - length: the shortest root element to max_length (if set)     */
+/*    - source: one of the 'allow' networks (if any)                  */
+/*    - payload: within its first ROOT_SCAN bytes, the first '<'      */
+/*      followed by a letter (so past <?xml ...?> and comments) must  */
+/*      open the root of a message type that has a handler, in any    */
+/*      case, and be followed by one of root_ends[]: the same rules   */
+/*      as msg_root().  The types that are only counted are dropped.  */
+/*  Offset 0 of a UDP socket's filter is the UDP header; the payload  */
+/*  starts at 8 and the IP header is at SKF_NET_OFF.  Classic BPF has */
+/*  no loops, so the search for '<' is unrolled, ROOT_SCAN blocks.    */
+/* ================================================================== */
+#define FILTER_INSNS  2048
+
+struct bpf_buf {
+    struct sock_filter insn[FILTER_INSNS];
+    unsigned int       n;
+    int                overflow;
+};
+
+static struct bpf_buf g_filter[2];   /* for IPv4, IPv6 sockets         */
+static int            g_filter_on;
+
+static unsigned int bpf_emit(struct bpf_buf *b, uint16_t code, uint8_t jt,
+                             uint8_t jf, uint32_t k)
+{
+    if (b->n == FILTER_INSNS) { b->overflow = 1; return b->n - 1; }
+    b->insn[b->n] = (struct sock_filter){ code, jt, jf, k };
+    return b->n++;
+}
+
+/* Point the 'ja' at 'at' to the next instruction to be emitted */
+static void bpf_land(struct bpf_buf *b, unsigned int at)
+{
+    if (!b->overflow) b->insn[at].k = b->n - at - 1;
+}
+
+/* Bytes p[0..n) big-endian, each letter's 0x20 bit set as the
+   filter sets it on the packet to ignore case */
+static uint32_t bpf_lower(const char *p, int n)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < n; i++) v = v << 8 | (uint8_t)(p[i] | 0x20);
+    return v;
+}
+
+/* The source-address test for 'family'; falls through when the source
+   is allowed.  config_load() refuses a list with no network of a
+   family that is listened on. */
+static void bpf_allow(struct bpf_buf *b, const struct allow_list *al,
+                      int family)
+{
+    unsigned int hit[ALLOW_MAX];
+    int          nhit = 0;
+    for (int r = 0; r < al->n; r++) {
+        const struct allow_net *a = &al->net[r];
+        if (a->family != family) continue;
+
+        /* 3 instructions per word the prefix reaches, then 'ja hit' */
+        int      words = (int)(a->prefix + 31) / 32, len = 1;
+        uint32_t mask[4], val[4];
+        for (int w = 0; w < words; w++) {
+            unsigned int bits = a->prefix - 32u * (unsigned int)w;
+            mask[w] = bits >= 32 ? 0xffffffffu : ~(0xffffffffu >> bits);
+            memcpy(&val[w], a->addr + 4 * w, 4);
+            val[w]  = ntohl(val[w]) & mask[w];
+            len    += mask[w] == 0xffffffffu ? 2 : 3;
+        }
+        int pos = 0;
+        for (int w = 0; w < words; w++) {
+            int32_t off = family == AF_INET ? 12 : 8 + 4 * w;
+            bpf_emit(b, BPF_LD | BPF_W | BPF_ABS, 0, 0,
+                     (uint32_t)(SKF_NET_OFF + off));
+            pos++;
+            if (mask[w] != 0xffffffffu) {
+                bpf_emit(b, BPF_ALU | BPF_AND | BPF_K, 0, 0, mask[w]);
+                pos++;
+            }
+            pos++;
+            bpf_emit(b, BPF_JMP | BPF_JEQ | BPF_K, 0,
+                     (uint8_t)(len - pos), val[w]);
+        }
+        hit[nhit++] = bpf_emit(b, BPF_JMP | BPF_JA, 0, 0, 0);
+    }
+    if (al->n == 0) return;
+    bpf_emit(b, BPF_RET | BPF_K, 0, 0, 0);
+    for (int i = 0; i < nhit; i++) bpf_land(b, hit[i]);
+}
+
+/* The whole program for sockets of 'family' */
+static void bpf_build(struct bpf_buf *b, const struct config *c, int family)
+{
+    memset(b, 0, sizeof(*b));
+    size_t shortest = SIZE_MAX;
+    for (int t = MSG_NONE + 1; t < MSG_TYPES; t++)
+        if (msg_handlers[t] && msg_roots[t].len < shortest)
+            shortest = msg_roots[t].len;
+
+    /* 8 + payload between "<root>" and max_length */
+    bpf_emit(b, BPF_LD | BPF_W | BPF_LEN, 0, 0, 0);
+    bpf_emit(b, BPF_JMP | BPF_JGE | BPF_K, 1, 0,
+             (uint32_t)(8 + shortest + 2));
+    bpf_emit(b, BPF_RET | BPF_K, 0, 0, 0);
+    if (c->max_length) {
+        bpf_emit(b, BPF_JMP | BPF_JGT | BPF_K, 0, 1, 8 + c->max_length);
+        bpf_emit(b, BPF_RET | BPF_K, 0, 0, 0);
+    }
+    bpf_allow(b, &c->allow, family);
+
+    /* X = offset of the root element's '<', the first one followed by
+       a letter as in msg_root(); reading past the end of the packet
+       drops it */
+    unsigned int found[ROOT_SCAN];
+    for (unsigned int i = 0; i < ROOT_SCAN; i++) {
+        bpf_emit(b, BPF_LD | BPF_B | BPF_ABS, 0, 0, 8 + i);
+        bpf_emit(b, BPF_JMP | BPF_JEQ | BPF_K, 0, 6, '<');
+        bpf_emit(b, BPF_LD | BPF_B | BPF_ABS, 0, 0, 8 + i + 1);
+        bpf_emit(b, BPF_ALU | BPF_OR | BPF_K, 0, 0, 0x20);     /* letter: */
+        bpf_emit(b, BPF_JMP | BPF_JGE | BPF_K, 0, 3, 'a');     /* a..z    */
+        bpf_emit(b, BPF_JMP | BPF_JGT | BPF_K, 2, 0, 'z');
+        bpf_emit(b, BPF_LDX | BPF_W | BPF_IMM, 0, 0, i);
+        found[i] = bpf_emit(b, BPF_JMP | BPF_JA, 0, 0, 0);
+    }
+    bpf_emit(b, BPF_RET | BPF_K, 0, 0, 0);
+    for (unsigned int i = 0; i < ROOT_SCAN; i++) bpf_land(b, found[i]);
+
+    /* The name after '<', 4, 2 or 1 bytes at a time, then '>', '/' or
+       white space, as is_root_end() */
+    for (int t = MSG_NONE + 1; t < MSG_TYPES; t++) {
+        if (!msg_handlers[t]) continue;
+        const char *name = msg_roots[t].root;
+        int         n    = (int)msg_roots[t].len, chunks = 0, pos = 0;
+        for (int o = 0; o < n; o += n - o >= 4 ? 4 : n - o >= 2 ? 2 : 1)
+            chunks++;
+        int len = 3 * chunks + 2 + ROOT_ENDS;
+        for (int o = 0, c; o < n; o += c) {
+            c = n - o >= 4 ? 4 : n - o >= 2 ? 2 : 1;
+            bpf_emit(b, BPF_LD | BPF_IND |
+                        (c == 4 ? BPF_W : c == 2 ? BPF_H : BPF_B),
+                     0, 0, (uint32_t)(9 + o));
+            bpf_emit(b, BPF_ALU | BPF_OR | BPF_K, 0, 0,
+                     c == 4 ? 0x20202020u : c == 2 ? 0x2020u : 0x20u);
+            pos += 3;
+            bpf_emit(b, BPF_JMP | BPF_JEQ | BPF_K, 0, (uint8_t)(len - pos),
+                     bpf_lower(name + o, c));
+        }
+        /* Each match jumps to the accept, the last miss past it */
+        bpf_emit(b, BPF_LD | BPF_B | BPF_IND, 0, 0, (uint32_t)(9 + n));
+        for (int e = 0; e < ROOT_ENDS; e++)
+            bpf_emit(b, BPF_JMP | BPF_JEQ | BPF_K,
+                     (uint8_t)(ROOT_ENDS - 1 - e), e == ROOT_ENDS - 1,
+                     (uint8_t)root_ends[e]);
+        bpf_emit(b, BPF_RET | BPF_K, 0, 0, 0xffffffffu);
+    }
+    bpf_emit(b, BPF_RET | BPF_K, 0, 0, 0);
+}
+
+/* Ask for a receive buffer of 'bytes' (0 = leave the default) and
+   return what the kernel granted.  The kernel doubles the request for
+   its bookkeeping and caps it at net.core.rmem_max, which
+   SO_RCVBUFFORCE may exceed when the listener has CAP_NET_ADMIN. */
+static int udp_set_rcvbuf(int sock, unsigned int bytes, int verbose)
+{
+    int       want = (int)bytes, got = 0;
+    socklen_t len  = sizeof(got);
+    if (want > 0 &&
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &want, sizeof(want)) < 0 &&
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &want, sizeof(want)) < 0)
+        perror("SO_RCVBUF");
+    getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &got, &len);
+    if (verbose) {
+        printf("Rcv buffer: %d bytes", got);
+        if (want > 0 && got < 2 * want)
+            printf(" (asked %d, capped by net.core.rmem_max)", want);
+        else if (want == 0)
+            printf(" (kernel default)");
+        printf("\n");
+    }
+    return got;
+}
+
+/* A non-blocking UDP socket bound to 'ep', or -1.  'shared' lets
+   other sockets (the other workers') bind the same endpoint. */
+static int udp_open(const struct endpoint *ep, int shared)
+{
+    char name[96];
+    endpoint_str(ep, name, sizeof(name));
+
+    int sock = socket(ep->addr.ss_family,
+                      SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) { perror("socket"); return -1; }
+
+    int yes = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    /* One socket per worker on the same endpoint.  The kernel spreads
+       unicast senders over them by address and port, but gives every
+       socket a copy of a broadcast; the destination address tells
+       which is which. */
+    if (shared) {
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) < 0)
+            perror("SO_REUSEPORT");
+        if (ep->addr.ss_family == AF_INET6)
+            setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &yes,
+                       sizeof(yes));
+        else
+            setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &yes, sizeof(yes));
+    }
+    /* Kernel receive timestamps for the latency histograms */
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &yes, sizeof(yes)) < 0)
+        perror("SO_TIMESTAMPNS");
+    /* Count of datagrams the kernel dropped, with every datagram */
+    if (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &yes, sizeof(yes)) < 0)
+        perror("SO_RXQ_OVFL");
+    udp_set_rcvbuf(sock, atomic_load(&g_rcvbuf), 0);
+    /* Before bind(), so nothing gets queued unfiltered */
+    if (g_filter_on) {
+        struct bpf_buf  *b    = &g_filter[ep->addr.ss_family == AF_INET6];
+        struct sock_fprog prog = { .len    = (unsigned short)b->n,
+                                   .filter = b->insn };
+        if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+                       sizeof(prog)) < 0)
+            fprintf(stderr, "%s: SO_ATTACH_FILTER: %s\n", name,
+                    strerror(errno));
+    }
+    /* [::] takes IPv6 only, so 0.0.0.0 on the same port can be listed */
+    if (ep->addr.ss_family == AF_INET6)
+        setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &yes, sizeof(yes));
+
+    if (ep->ifname[0] &&
+        setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, ep->ifname,
+                   (socklen_t)strlen(ep->ifname)) < 0) {
+        fprintf(stderr, "%s: SO_BINDTODEVICE: %s\n", name, strerror(errno));
+        close(sock);
+        return -1;
+    }
+    if (bind(sock, (const struct sockaddr *)&ep->addr, ep->addrlen) < 0) {
+        fprintf(stderr, "%s: bind: %s\n", name, strerror(errno));
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* One receive call into the ring.  Returns datagrams, or -1. */
+static int recv_batch(int sock, struct recv_ring *ring, int flags)
+{
+    recv_ring_reset(ring, ring->batch);
+    int n;
+    if (ring->batch == 1) {
+        ssize_t rc = recvmsg(sock, &ring->msgs[0].msg_hdr, flags);
+        if (rc >= 0) ring->msgs[0].msg_len = (unsigned int)rc;
+        n = rc < 0 ? -1 : 1;
+    } else {
+        n = recvmmsg(sock, ring->msgs, ring->batch, flags, NULL);
+    }
+    if (n < 0) return -1;
+    ring->syscalls++;
+    ring->datagrams += (unsigned long long)n;
+    return n;
+}
+
+/* ================================================================== */
+/*  io_uring receive                                                    */
+/*                                                                      */
+/*  receive = io_uring: one multishot IORING_OP_RECVMSG per socket    */
+/*  keeps delivering datagrams into buffers the kernel takes from a   */
+/*  registered ring of provided buffers.  Each buffer holds an        */
+/*  io_uring_recvmsg_out header, the source address, the cmsgs and    */
+/*  the payload.  Completions are read from the mapped CQ ring with   */
+/*  no system call per datagram; the ring's fd sits in the receive    */
+/*  loop's epoll set, and a buffer goes back to the kernel as soon as */
+/*  its datagram has been handled.                                     */
+/*                                                                      */
+/*  Raw system calls, no liburing.  Multishot recvmsg needs Linux 6.0; */
+/*  uring_probe() checks once at startup and the listener falls back  */
+/*  to recvmmsg() without it (or without the headers at build time).  */
+/* ================================================================== */
+#define URING_ENTRIES   16          /* SQ entries                      */
+#define URING_BUFFERS   64          /* provided buffers per loop (2^n) */
+#define URING_CQ        (2 * URING_BUFFERS)   /* CQ: a completion per
+                                       buffer in use, plus the ends of
+                                       receives and cancels           */
+#define URING_BGID      0           /* buffer group, one per ring      */
+#define URING_CANCEL    0xffffu     /* user_data of a cancel request  */
+
+static int g_recv_uring;            /* asked for, and the kernel can  */
+
+#ifdef HAVE_URING
+#define URING_BUF_SIZE  (sizeof(struct io_uring_recvmsg_out) + \
+                         sizeof(struct sockaddr_storage) + \
+                         RECV_CTRL_SIZE + RECV_SLOT_SIZE)
+
+struct uring {
+    int                       fd;
+    unsigned int             *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int             *sq_flags;
+    struct io_uring_sqe      *sqes;
+    unsigned int             *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe      *cqes;
+    void                     *sq_map, *cq_map;
+    size_t                    sq_len, cq_len, sqes_len;
+    struct io_uring_buf_ring *br;    /* provided buffers, shared       */
+    char                     *bufs;  /* URING_BUFFERS * URING_BUF_SIZE */
+    unsigned int              br_tail;
+    unsigned int              queued; /* SQEs not yet submitted        */
+    struct msghdr             msg;   /* buffer layout for the kernel   */
+};
+
+static int uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned int submit, unsigned int wait,
+                       unsigned int flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags,
+                        NULL, 0);
+}
+
+/* Can this kernel do what the io_uring backend needs?  Setting up a
+   ring with IORING_SETUP_SINGLE_ISSUER, which came with multishot
+   recvmsg in 6.0, answers that without sending anything.  0 = yes,
+   else -1 with errno set. */
+static int uring_probe(void)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SINGLE_ISSUER;
+    int fd = uring_setup(2, &p);
+    if (fd < 0) return -1;
+    close(fd);
+    return 0;
+}
+
+/* Give buffer 'bid' (back) to the kernel */
+static void uring_recycle(struct uring *u, unsigned int bid)
+{
+    struct io_uring_buf *b = &u->br->bufs[u->br_tail & (URING_BUFFERS - 1)];
+    b->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * URING_BUF_SIZE);
+    b->len  = (uint32_t)URING_BUF_SIZE;
+    b->bid  = (uint16_t)bid;
+    u->br_tail++;
+    __atomic_store_n(&u->br->tail, (uint16_t)u->br_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_free(struct uring *u)
+{
+    if (u->fd >= 0) close(u->fd);
+    if (u->sqes) munmap(u->sqes, u->sqes_len);
+    if (u->cq_map && u->cq_map != u->sq_map) munmap(u->cq_map, u->cq_len);
+    if (u->sq_map) munmap(u->sq_map, u->sq_len);
+    if (u->br) munmap(u->br, URING_BUFFERS * sizeof(struct io_uring_buf));
+    if (u->bufs) munmap(u->bufs, (size_t)URING_BUFFERS * URING_BUF_SIZE);
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+}
+
+/* A ring with URING_BUFFERS provided buffers in group URING_BGID */
+static int uring_init(struct uring *u)
+{
+    memset(u, 0, sizeof(*u));
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags      = IORING_SETUP_CQSIZE;
+    p.cq_entries = URING_CQ;
+    u->fd = uring_setup(URING_ENTRIES, &p);
+    if (u->fd < 0) return -1;
+
+    u->sq_len   = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    u->cq_len   = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP && u->cq_len > u->sq_len)
+        u->sq_len = u->cq_len;
+    u->sq_map = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_map == MAP_FAILED) { u->sq_map = NULL; goto fail; }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_map = u->sq_map;
+    } else {
+        u->cq_map = mmap(NULL, u->cq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_map == MAP_FAILED) { u->cq_map = NULL; goto fail; }
+    }
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) { u->sqes = NULL; goto fail; }
+
+    char *sq = u->sq_map, *cq = u->cq_map;
+    u->sq_head  = (unsigned int *)(sq + p.sq_off.head);
+    u->sq_tail  = (unsigned int *)(sq + p.sq_off.tail);
+    u->sq_mask  = (unsigned int *)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned int *)(sq + p.sq_off.array);
+    u->sq_flags = (unsigned int *)(sq + p.sq_off.flags);
+    u->cq_head  = (unsigned int *)(cq + p.cq_off.head);
+    u->cq_tail  = (unsigned int *)(cq + p.cq_off.tail);
+    u->cq_mask  = (unsigned int *)(cq + p.cq_off.ring_mask);
+    u->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    /* The buffer ring must be page aligned; mmap() is */
+    u->br = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf),
+                 PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->br == MAP_FAILED) { u->br = NULL; goto fail; }
+    u->bufs = mmap(NULL, (size_t)URING_BUFFERS * URING_BUF_SIZE,
+                   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->bufs == MAP_FAILED) { u->bufs = NULL; goto fail; }
+    struct io_uring_buf_reg reg = {
+        .ring_addr    = (uint64_t)(uintptr_t)u->br,
+        .ring_entries = URING_BUFFERS,
+        .bgid         = URING_BGID,
+    };
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING,
+                &reg, 1) < 0)
+        goto fail;
+    for (unsigned int i = 0; i < URING_BUFFERS; i++)
+        uring_recycle(u, i);
+
+    /* Only the lengths matter: where the name and cmsgs go in a buffer */
+    u->msg.msg_namelen    = sizeof(struct sockaddr_storage);
+    u->msg.msg_controllen = RECV_CTRL_SIZE;
+    return 0;
+
+fail:;
+    int err = errno;
+    uring_free(u);
+    errno = err;
+    return -1;
+}
+
+static struct io_uring_sqe *uring_sqe(struct uring *u)
+{
+    unsigned int tail = *u->sq_tail;
+    unsigned int head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head > *u->sq_mask) {         /* full: hand them over */
+        uring_enter(u->fd, u->queued, 0, 0);
+        u->queued = 0;
+    }
+    unsigned int idx = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    u->queued++;
+    return sqe;
+}
+
+static int uring_submit(struct uring *u)
+{
+    int rc = u->queued ? uring_enter(u->fd, u->queued, 0, 0) : 0;
+    u->queued = 0;
+    return rc;
+}
+
+/* Block until the ring has at least one completion */
+static int uring_wait(struct uring *u)
+{
+    return uring_enter(u->fd, 0, 1, IORING_ENTER_GETEVENTS);
+}
+
+/* Multishot recvmsg on 'fd' into the provided buffers */
+static void uring_arm(struct uring *u, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = uring_sqe(u);
+    sqe->opcode    = IORING_OP_RECVMSG;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t)(uintptr_t)&u->msg;
+    sqe->len       = 1;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = user_data;
+}
+
+static void uring_cancel(struct uring *u, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = uring_sqe(u);
+    sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe->fd        = -1;
+    sqe->addr      = user_data;
+    sqe->user_data = URING_CANCEL;
+}
+
+/* Source address, cmsgs and payload of a completed receive: 'mh'
+   gets the cmsgs so recv_cmsg() can read them.  Returns the payload
+   length, or -1 for a buffer too short to hold the header. */
+static long uring_datagram(const struct uring *u, char *buf, int res,
+                           struct sockaddr_storage *src, struct msghdr *mh,
+                           char **payload)
+{
+    const struct io_uring_recvmsg_out *out = (const void *)buf;
+    size_t head = sizeof(*out) + u->msg.msg_namelen + u->msg.msg_controllen;
+    if (res < 0 || (size_t)res < head) return -1;
+
+    size_t namelen = out->namelen;
+    if (namelen > sizeof(*src)) namelen = sizeof(*src);
+    memset(src, 0, sizeof(*src));
+    memcpy(src, buf + sizeof(*out), namelen);
+    memset(mh, 0, sizeof(*mh));
+    mh->msg_control    = buf + sizeof(*out) + u->msg.msg_namelen;
+    mh->msg_controllen = out->controllen;
+    *payload = buf + head;
+    return (long)((size_t)res - head);
+}
+#else  /* !HAVE_URING */
+struct uring { int fd; };
+
+static int  uring_probe(void)           { errno = ENOSYS; return -1; }
+static int  uring_init(struct uring *u) { u->fd = -1; errno = ENOSYS; return -1; }
+static void uring_free(struct uring *u) { (void)u; }
+static int  uring_submit(struct uring *u) { (void)u; return 0; }
+static int  uring_wait(struct uring *u)   { (void)u; errno = ENOSYS; return -1; }
+static void uring_arm(struct uring *u, int fd, uint64_t user_data)
+{
+    (void)u; (void)fd; (void)user_data;
+}
+static void uring_cancel(struct uring *u, uint64_t user_data)
+{
+    (void)u; (void)user_data;
+}
+#endif /* HAVE_URING */
+
+/* ================================================================== */
+/*  Receive loop                                                        */
+/*                                                                      */
+/*  One thread and one epoll set: a socket per 'listen' endpoint, the */
+/*  eventfd the config thread writes after publishing new settings, a */
+/*  timerfd for the periodic report and a signalfd for SIGINT,        */
+/*  SIGTERM and SIGUSR1.  Sockets are level-triggered and give one    */
+/*  batch per wake-up, so a busy port cannot starve the others.       */
+/*                                                                      */
+/*  With workers, each worker runs this loop on its own SO_REUSEPORT  */
+/*  sockets and only parses; the main thread's loop keeps the timer,  */
+/*  the signals and the config eventfd, and is the trigger stage.     */
+/* ================================================================== */
+enum { LOOP_WAKE = LISTEN_MAX, LOOP_TIMER, LOOP_SIGNAL, LOOP_STAGE,
+       LOOP_URING };
+
+#define WORKER_QUEUE_LEN  256       /* parsed contacts per worker, a
+                                       power of two                   */
+
+/* Counters written by one receive thread and read by the main one
+   for reports: relaxed atomics, so a 64-bit count cannot tear on a
+   32-bit Pi.  One writer, so a load and a store, no read-modify-write. */
+static void cnt_add(atomic_ullong *c, unsigned long long n)
+{
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed)
+                             + n, memory_order_relaxed);
+}
+
+static unsigned long long cnt_get(const atomic_ullong *c)
+{
+    return atomic_load_explicit(c, memory_order_relaxed);
+}
+
+struct rx_socket {
+    int                fd;           /* -1 = free slot                  */
+    struct endpoint    ep;
+    atomic_ullong      datagrams, bytes, contacts;
+    atomic_ullong      drops;        /* SO_RXQ_OVFL, kept by the kernel */
+    int                armed;        /* io_uring receive outstanding   */
+    int                closing;
+};
+
+/* Totals of one or more sockets, as read at one point */
+struct rx_counts {
+    unsigned long long datagrams, bytes, contacts, drops;
+};
+
+/* Counts at the previous report */
+struct recv_report {
+    uint64_t           at_ns;
+    unsigned long long datagrams, drops, contacts, bells;
+};
+
+struct rx_worker;
+
+struct rx_loop {
+    int                epfd, timerfd, sigfd;   /* -1 in a worker       */
+    int                wakefd;       /* eventfd: settings changed       */
+    atomic_int         stop;
+    struct rx_socket   sock[LISTEN_MAX];
+    struct rx_socket   closed;       /* totals of sockets closed since */
+    struct recv_ring   ring;
+    struct uring      *uring;        /* NULL: recvmmsg() on epoll      */
+    struct uring       uring_mem;
+    int                running;      /* rx_run() has started           */
+    unsigned int       rcvbuf, interval;
+    struct recv_report last;
+    struct rx_worker  *worker;       /* NULL: parse and trigger inline */
+    int                nworkers;     /* main loop: workers it drains   */
+    atomic_ullong      msgs[MSG_TYPES];  /* datagrams by root element  */
+};
+
+/* A receive thread pinned to one core.  Its loop, ring and counts are
+   its own; the main thread reads the counts only for reports, so a
+   report may be a batch behind. */
+struct rx_worker {
+    struct rx_loop     loop;
+    int                id, cpu;      /* cpu -1 = not pinned             */
+    pthread_t          tid;
+    struct spsc_ring   queue;        /* parsed contacts, to main        */
+    atomic_ullong      queue_full;   /* contacts lost to a full queue  */
+    atomic_ullong      copies;       /* broadcasts left to worker 0    */
+    pthread_mutex_t    lock;         /* guards next / has_next          */
+    struct listen_set  next;         /* listen set to switch to        */
+    int                has_next;
+};
+
+static struct rx_worker g_worker[WORKER_MAX];
+static int              g_nworkers;  /* 0 = no workers                 */
+static int              g_stage_wake = -1;  /* eventfd: contacts queued */
+
+/* Parse on a worker and queue a message with a handler for the
+   trigger stage.  Returns the message type. */
+static enum msg_type worker_queue(struct rx_worker *w, const char *buf,
+                                  size_t len,
+                                  const struct sockaddr_storage *src,
+                                  const struct timespec *rx)
+{
+    struct xml_fields fl;
+    enum msg_type     t = msg_parse(buf, len, &fl);
+    if (!msg_handlers[t]) return t;
+    struct parsed_contact pc;
+    pc.rx_ns     = ts_ns(rx);
+    pc.parsed_ns = now_ns();
+    pc.src       = *src;
+    pc.type      = t;
+    contact_pack(&pc, &fl);
+    if (spsc_push(&w->queue, &pc) < 0) cnt_add(&w->queue_full, 1);
+    return t;
+}
+
+/* One datagram, whichever way it came in.  Returns 1 if a worker
+   queued it for the trigger stage. */
+static int handle_datagram(struct rx_loop *l, struct rx_socket *rs,
+                           const char *buf, size_t len,
+                           const struct sockaddr_storage *src,
+                           struct msghdr *mh)
+{
+    struct timespec rx;
+    uint32_t drops = (uint32_t)cnt_get(&rs->drops);
+    int group = recv_cmsg(mh, &rx, &drops);
+    atomic_store_explicit(&rs->drops, drops, memory_order_relaxed);
+    cnt_add(&rs->bytes, len);
+    cnt_add(&rs->datagrams, 1);
+    /* Every worker got this one; worker 0 takes it */
+    if (group && l->worker && l->worker->id != 0) {
+        cnt_add(&l->worker->copies, 1);
+        return 0;
+    }
+    if (g_capture)
+        capture_write(&rx, src, buf, len);
+    enum msg_type t = l->worker ? worker_queue(l->worker, buf, len, src, &rx)
+                                : process_datagram(buf, len, src, &rx);
+    cnt_add(&l->msgs[t], 1);
+    if (t == MSG_CONTACT) cnt_add(&rs->contacts, 1);
+    return msg_handlers[t] != NULL;
+}
+
+/* After a batch: flush the capture and, if a worker queued contacts,
+   wake the trigger stage once */
+static void handle_done(struct rx_loop *l, int queued)
+{
+    capture_flush();
+    uint64_t one = 1;
+    if (queued && l->worker &&
+        write(g_stage_wake, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("stage wake");
+}
+
+static void handle_batch(struct rx_loop *l, int n, struct rx_socket *rs)
+{
+    struct recv_ring *ring   = &l->ring;
+    int               queued = 0;
+    for (int i = 0; i < n; i++)
+        queued |= handle_datagram(l, rs,
+                                  ring->bufs + (size_t)i * RECV_SLOT_SIZE,
+                                  ring->msgs[i].msg_len, &ring->srcs[i],
+                                  &ring->msgs[i].msg_hdr);
+    handle_done(l, queued);
+}
+
+/* Start a multishot receive on every socket without one.  Only from
+   the loop's own thread: the kernel runs the completion work on the
+   thread that submitted the request. */
+static void rx_uring_arm(struct rx_loop *l)
+{
+    if (!l->uring) return;
+    for (int s = 0; s < LISTEN_MAX; s++) {
+        struct rx_socket *rs = &l->sock[s];
+        if (rs->fd < 0 || rs->armed || rs->closing) continue;
+        uring_arm(l->uring, rs->fd, (uint64_t)s);
+        rs->armed = 1;
+    }
+    if (uring_submit(l->uring) < 0) perror("io_uring_enter");
+}
+
+/* Every completion the ring has: datagrams handled and their buffers
+   given back, a multishot receive that ended armed again.  Running
+   out of buffers ends one; so does an error, which is not retried. */
+static void rx_uring_reap(struct rx_loop *l)
+{
+#ifdef HAVE_URING
+    struct uring *u      = l->uring;
+
+    /* Completions that found the CQ full wait for the next enter */
+    if (__atomic_load_n(u->sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)
+        uring_enter(u->fd, 0, 0, IORING_ENTER_GETEVENTS);
+    unsigned int  head   = *u->cq_head;
+    unsigned int  tail   = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned int  rearm  = 0;
+    int           queued = 0;
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+        if (cqe->user_data == URING_CANCEL) continue;
+        struct rx_socket *rs = &l->sock[cqe->user_data];
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            unsigned int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            struct sockaddr_storage src;
+            struct msghdr mh;
+            char *payload;
+            long len = uring_datagram(u, u->bufs + (size_t)bid * URING_BUF_SIZE,
+                                      cqe->res, &src, &mh, &payload);
+            if (len >= 0)
+                queued |= handle_datagram(l, rs, payload, (size_t)len,
+                                          &src, &mh);
+            uring_recycle(u, bid);
+            l->ring.datagrams++;
+        } else if (cqe->res < 0 && cqe->res != -ENOBUFS &&
+                   cqe->res != -ECANCELED) {
+            char name[96];
+            fprintf(stderr, "%s: io_uring recvmsg: %s\n",
+                    endpoint_str(&rs->ep, name, sizeof(name)),
+                    strerror(-cqe->res));
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            rs->armed = 0;
+            if (rs->fd >= 0 && !rs->closing &&
+                (cqe->res >= 0 || cqe->res == -ENOBUFS))
+                rearm |= 1u << cqe->user_data;
+        }
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    l->ring.syscalls++;
+
+    for (int s = 0; s < LISTEN_MAX; s++)
+        if (rearm & (1u << s)) {
+            uring_arm(u, l->sock[s].fd, (uint64_t)s);
+            l->sock[s].armed = 1;
+        }
+    if (rearm) uring_submit(u);
+    handle_done(l, queued);
+#else
+    (void)l;
+#endif
+}
+
+static int rx_open(struct rx_loop *l, const struct endpoint *ep)
+{
+    int slot = 0;
+    while (slot < LISTEN_MAX && l->sock[slot].fd >= 0) slot++;
+    if (slot == LISTEN_MAX) return -1;
+
+    int fd = udp_open(ep, l->worker != NULL);
+    if (fd < 0) return -1;
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = (uint64_t)slot };
+    if (!l->uring && epoll_ctl(l->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl");
+        close(fd);
+        return -1;
+    }
+    struct rx_socket *rs = &l->sock[slot];
+    memset(rs, 0, sizeof(*rs));
+    rs->fd = fd;
+    rs->ep = *ep;
+    if (l->running) rx_uring_arm(l);
+
+    /* Every worker opens the same endpoints; the first one tells */
+    char name[96];
+    if (!l->worker || l->worker->id == 0) {
+        printf("Listening on %s …\n", endpoint_str(ep, name, sizeof(name)));
+        fflush(stdout);
+    }
+    return 0;
+}
+
+/* Take what is still queued, then close and keep the counts */
+static void rx_close(struct rx_loop *l, struct rx_socket *rs)
+{
+    /* Stop the multishot receive, taking what it still delivers */
+    if (l->uring && rs->armed) {
+        rs->closing = 1;
+        uring_cancel(l->uring, (uint64_t)(rs - l->sock));
+        uring_submit(l->uring);
+        while (rs->armed) {
+            if (uring_wait(l->uring) < 0 && errno != EINTR) break;
+            rx_uring_reap(l);
+        }
+    }
+    int n;
+    while ((n = recv_batch(rs->fd, &l->ring, MSG_DONTWAIT)) > 0)
+        handle_batch(l, n, rs);
+    close(rs->fd);                   /* also leaves the epoll set     */
+    rs->fd = -1;
+    cnt_add(&l->closed.datagrams, cnt_get(&rs->datagrams));
+    cnt_add(&l->closed.bytes,     cnt_get(&rs->bytes));
+    cnt_add(&l->closed.contacts,  cnt_get(&rs->contacts));
+    cnt_add(&l->closed.drops,     cnt_get(&rs->drops));
+
+    char name[96];
+    if (!l->worker || l->worker->id == 0) {
+        printf("Stopped listening on %s\n",
+               endpoint_str(&rs->ep, name, sizeof(name)));
+        fflush(stdout);
+    }
+}
+
+/* Listen on exactly 'ls': open the new sockets first, then close the
+   ones no longer wanted, so nothing is missed in between.  An endpoint
+   that cannot be opened is reported and left out. */
+static void rx_listen(struct rx_loop *l, const struct listen_set *ls)
+{
+    for (int i = 0; i < ls->n; i++) {
+        int open = 0;
+        for (int s = 0; s < LISTEN_MAX; s++)
+            open |= l->sock[s].fd >= 0 && endpoint_eq(&l->sock[s].ep,
+                                                       &ls->ep[i]);
+        if (!open) rx_open(l, &ls->ep[i]);
+    }
+    for (int s = 0; s < LISTEN_MAX; s++) {
+        struct rx_socket *rs = &l->sock[s];
+        if (rs->fd < 0) continue;
+        int wanted = 0;
+        for (int i = 0; i < ls->n; i++)
+            wanted |= endpoint_eq(&rs->ep, &ls->ep[i]);
+        if (!wanted) rx_close(l, rs);
+    }
+}
+
+static int rx_count(const struct rx_loop *l)
+{
+    int n = 0;
+    for (int s = 0; s < LISTEN_MAX; s++) n += l->sock[s].fd >= 0;
+    return n;
+}
+
+static struct rx_counts rx_counts(const struct rx_socket *rs)
+{
+    return (struct rx_counts){
+        .datagrams = cnt_get(&rs->datagrams),
+        .bytes     = cnt_get(&rs->bytes),
+        .contacts  = cnt_get(&rs->contacts),
+        .drops     = cnt_get(&rs->drops),
+    };
+}
+
+static void rx_counts_add(struct rx_counts *t, const struct rx_counts *c)
+{
+    t->datagrams += c->datagrams;
+    t->bytes     += c->bytes;
+    t->contacts  += c->contacts;
+    t->drops     += c->drops;
+}
+
+/* Every socket's counts plus those of closed ones, over all workers */
+static struct rx_counts rx_total(const struct rx_loop *l)
+{
+    struct rx_counts t = rx_counts(&l->closed);
+    for (int s = 0; s < LISTEN_MAX; s++) {
+        if (l->sock[s].fd < 0) continue;
+        struct rx_counts c = rx_counts(&l->sock[s]);
+        rx_counts_add(&t, &c);
+    }
+    for (int w = 0; w < l->nworkers; w++) {
+        struct rx_counts wt = rx_total(&g_worker[w].loop);
+        rx_counts_add(&t, &wt);
+    }
+    return t;
+}
+
+static void rx_dump_sockets(FILE *f, const struct rx_loop *l)
+{
+    char name[96];
+    for (int s = 0; s < LISTEN_MAX; s++) {
+        const struct rx_socket *rs = &l->sock[s];
+        if (rs->fd < 0) continue;
+        struct rx_counts c = rx_counts(rs);
+        fprintf(f, "  %-32s %9llu %12llu %9llu %13llu\n",
+                endpoint_str(&rs->ep, name, sizeof(name)),
+                c.datagrams, c.bytes, c.contacts, c.drops);
+    }
+    struct rx_counts c = rx_counts(&l->closed);
+    if (c.datagrams || c.drops)
+        fprintf(f, "  %-32s %9llu %12llu %9llu %13llu\n", "(closed)",
+                c.datagrams, c.bytes, c.contacts, c.drops);
+}
+
+/* Add the datagrams by message type of 'l' and its workers to n[] */
+static void rx_msgs(const struct rx_loop *l, unsigned long long *n)
+{
+    for (int t = 0; t < MSG_TYPES; t++) n[t] += cnt_get(&l->msgs[t]);
+    for (int w = 0; w < l->nworkers; w++) rx_msgs(&g_worker[w].loop, n);
+}
+
+static void rx_dump(FILE *f, const struct rx_loop *l)
+{
+    fprintf(f, "Socket                             datagrams        bytes"
+               "  contacts  kernel drops%s\n",
+            g_filter_on ? " (incl. filtered)" : "");
+    rx_dump_sockets(f, l);
+    for (int i = 0; i < l->nworkers; i++) {
+        const struct rx_worker *w = &g_worker[i];
+        fprintf(f, "Worker %d", w->id);
+        if (w->cpu >= 0) fprintf(f, " (cpu %d)", w->cpu);
+        unsigned long long copies = cnt_get(&w->copies);
+        unsigned long long full   = cnt_get(&w->queue_full);
+        if (copies)
+            fprintf(f, ", %llu broadcasts left to worker 0", copies);
+        if (full)
+            fprintf(f, ", %llu contacts lost (queue full)", full);
+        fprintf(f, "\n");
+        rx_dump_sockets(f, &w->loop);
+    }
+
+    unsigned long long n[MSG_TYPES] = { 0 };
+    const char        *sep = "Messages:";
+    rx_msgs(l, n);
+    for (int t = MSG_NONE + 1; t <= MSG_TYPES; t++) {
+        int i = t % MSG_TYPES;                /* "other" last        */
+        if (!n[i]) continue;
+        fprintf(f, "%s %llu %s", sep, n[i], msg_roots[i].root);
+        sep = ",";
+    }
+    if (*sep == ',') fprintf(f, "\n");
+}
+
+static void recv_report(FILE *f, struct rx_loop *l)
+{
+    struct rx_counts   t   = rx_total(l);
+    struct recv_report now = {
+        .at_ns     = now_ns(),
+        .datagrams = t.datagrams,
+        .drops     = t.drops,
+        .contacts  = g_state->stats.contacts,
+        .bells     = g_state->stats.bells,
+    };
+    const struct recv_report *last = &l->last;
+    time_t    sec = (time_t)(now.at_ns / 1000000000u);
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    /* The kernel counts what the socket filter drops as drops too */
+    fprintf(f, "%02d:%02d:%02d  last %.0f s: %llu received, %llu %s"
+               "by the kernel, %llu contacts, %llu bells  (total %llu "
+               "received, %llu dropped)\n",
+            tm.tm_hour, tm.tm_min, tm.tm_sec,
+            (double)(now.at_ns - last->at_ns) / 1e9,
+            now.datagrams - last->datagrams, now.drops - last->drops,
+            g_filter_on ? "filtered or dropped " : "dropped ",
+            now.contacts - last->contacts, now.bells - last->bells,
+            now.datagrams, now.drops);
+    fflush(f);
+    l->last = now;
+}
+
+/* (Re)arm the periodic report every 's' seconds, 0 = off */
+static void report_timer(struct rx_loop *l, unsigned int s)
+{
+    struct itimerspec it = {
+        .it_interval = { .tv_sec = (time_t)s },
+        .it_value    = { .tv_sec = (time_t)s },
+    };
+    timerfd_settime(l->timerfd, 0, &it, NULL);
+    l->interval = s;
+}
+
+static void worker_wake(struct rx_worker *w)
+{
+    uint64_t one = 1;
+    if (write(w->loop.wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("worker wake");
+}
+
+/* The config thread has published new settings; in the main loop of
+   a worker setup they are passed on to every worker */
+static void rx_reconfigure(struct rx_loop *l)
+{
+    uint64_t n;
+    if (read(l->wakefd, &n, sizeof(n)) < 0 && errno != EAGAIN)
+        perror("receive wake");
+
+    struct rx_worker *w = l->worker;
+    if (w) {
+        struct listen_set ls;
+        pthread_mutex_lock(&w->lock);
+        int has = w->has_next;
+        if (has) ls = w->next;
+        w->has_next = 0;
+        pthread_mutex_unlock(&w->lock);
+        if (has) rx_listen(l, &ls);
+    } else {
+        struct listen_set *ls = atomic_exchange(&g_listen_pending, NULL);
+        if (ls) {
+            for (int i = 0; i < l->nworkers; i++) {
+                pthread_mutex_lock(&g_worker[i].lock);
+                g_worker[i].next     = *ls;
+                g_worker[i].has_next = 1;
+                pthread_mutex_unlock(&g_worker[i].lock);
+            }
+            if (!l->nworkers) rx_listen(l, ls);
+            free(ls);
+        }
+        for (int i = 0; i < l->nworkers; i++)
+            worker_wake(&g_worker[i]);
+    }
+    unsigned int rcvbuf = atomic_load(&g_rcvbuf);
+    if (rcvbuf != l->rcvbuf) {
+        l->rcvbuf = rcvbuf;
+        int first = !w || w->id == 0;
+        for (int s = 0; s < LISTEN_MAX; s++)
+            if (l->sock[s].fd >= 0) {
+                udp_set_rcvbuf(l->sock[s].fd, rcvbuf, first);
+                first = 0;
+            }
+    }
+    if (l->timerfd >= 0 && atomic_load(&g_stats_interval) != l->interval)
+        report_timer(l, atomic_load(&g_stats_interval));
+}
+
+/* Handle pending signals.  Returns 1 to stop. */
+static int rx_signals(struct rx_loop *l)
+{
+    struct signalfd_siginfo si;
+    int stop = 0;
+    while (read(l->sigfd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {
+        if (si.ssi_signo == SIGUSR1) {
+            lat_dump(stdout);
+            dedup_dump(stdout, &g_state->dedup);
+            mult_dump(stdout, &g_state->mults);
+            rx_dump(stdout, l);
+            recv_report(stdout, l);
+        } else {
+            stop = 1;
+        }
+    }
+    return stop;
+}
+
+/* ================================================================== */
+/*  Trigger stage                                                       */
+/*                                                                      */
+/*  Takes the workers' parsed contacts oldest first, by kernel receive */
+/*  time among those queued, and runs its type's handler on each, so  */
+/*  the mult index, dedup cache, bells and log keep a single writer.  */
+/* ================================================================== */
+static void stage_drain(void)
+{
+    for (;;) {
+        struct rx_worker *next = NULL;
+        uint64_t          best = 0;
+        for (int i = 0; i < g_nworkers; i++) {
+            const struct parsed_contact *pc = spsc_peek(&g_worker[i].queue);
+            if (pc && (!next || pc->rx_ns < best)) {
+                next = &g_worker[i];
+                best = pc->rx_ns;
+            }
+        }
+        if (!next) break;
+
+        struct parsed_contact pc;
+        struct xml_fields     fl;
+        spsc_pop(&next->queue, &pc);
+        contact_unpack(&pc, &fl);
+        msg_handlers[pc.type](&fl, &pc.src, pc.rx_ns, pc.parsed_ns);
+    }
+}
+
+/* Serve the loop's epoll set until its 'stop' is set */
+static void rx_run(struct rx_loop *l)
+{
+    struct epoll_event evs[LISTEN_MAX + 5];
+    l->running = 1;
+    rx_uring_arm(l);
+    while (!atomic_load_explicit(&l->stop, memory_order_relaxed)) {
+        int n = epoll_wait(l->epfd, evs, (int)(sizeof(evs) / sizeof(evs[0])),
+                           -1);
+        if (n < 0) {
+            if (errno != EINTR) { perror("epoll_wait"); break; }
+            continue;
+        }
+        for (int i = 0; i < n && !atomic_load(&l->stop); i++) {
+            uint64_t tag = evs[i].data.u64;
+            if (tag == LOOP_SIGNAL) {
+                if (rx_signals(l)) {
+                    g_stop = 1;
+                    atomic_store(&l->stop, 1);
+                }
+            } else if (tag == LOOP_TIMER) {
+                uint64_t expired;
+                if (read(l->timerfd, &expired, sizeof(expired)) > 0)
+                    recv_report(stdout, l);
+            } else if (tag == LOOP_WAKE) {
+                rx_reconfigure(l);
+            } else if (tag == LOOP_URING) {
+                rx_uring_reap(l);
+            } else if (tag == LOOP_STAGE) {
+                uint64_t queued;
+                if (read(g_stage_wake, &queued, sizeof(queued)) > 0)
+                    stage_drain();
+            } else {
+                struct rx_socket *rs = &l->sock[tag];
+                if (rs->fd < 0) continue;    /* closed by rx_reconfigure */
+                int k = recv_batch(rs->fd, &l->ring, MSG_DONTWAIT);
+                if (k > 0)
+                    handle_batch(l, k, rs);
+                else if (k < 0 && errno != EAGAIN && errno != EINTR)
+                    perror("recv");
+            }
+        }
+    }
+}
+
+/* An epoll set with the loop's fixed descriptors (-1 = not used) and
+   its receive ring */
+static int rx_init(struct rx_loop *l, unsigned int batch, int stagefd)
+{
+    for (int s = 0; s < LISTEN_MAX; s++) l->sock[s].fd = -1;
+    atomic_init(&l->stop, 0);
+    l->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (l->epfd < 0) return -1;
+    const struct { int fd; uint64_t tag; } fixed[] = {
+        { l->wakefd, LOOP_WAKE }, { l->timerfd, LOOP_TIMER },
+        { l->sigfd, LOOP_SIGNAL }, { stagefd, LOOP_STAGE },
+    };
+    for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = fixed[i].tag };
+        if (fixed[i].fd >= 0 &&
+            epoll_ctl(l->epfd, EPOLL_CTL_ADD, fixed[i].fd, &ev) < 0)
+            return -1;
+    }
+    l->rcvbuf = atomic_load(&g_rcvbuf);
+
+    /* Sockets then have no place in the epoll set, the ring does */
+    if (g_recv_uring && l->nworkers == 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = LOOP_URING };
+        if (uring_init(&l->uring_mem) < 0 ||
+            epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->uring_mem.fd, &ev) < 0) {
+            fprintf(stderr, "io_uring: %s, using recvmmsg()\n",
+                    strerror(errno));
+            uring_free(&l->uring_mem);
+        } else {
+            l->uring = &l->uring_mem;
+        }
+    }
+    /* The recvmmsg() ring only drains a closing socket then */
+    return recv_ring_init(&l->ring, l->uring ? 1 : batch);
+}
+
+static void rx_free(struct rx_loop *l)
+{
+    for (int s = 0; s < LISTEN_MAX; s++)
+        if (l->sock[s].fd >= 0) close(l->sock[s].fd);
+    if (l->uring) uring_free(l->uring);
+    recv_ring_free(&l->ring);
+    close(l->epfd);
+}
+
+static void *worker_thread(void *arg)
+{
+    struct rx_worker *w = arg;
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0) {
+            fprintf(stderr, "Worker %d: cannot pin to cpu %d: %s\n",
+                    w->id, w->cpu, strerror(rc));
+            w->cpu = -1;
+        }
+    }
+    ALLOC_STEADY();
+    rx_run(&w->loop);
+    return NULL;
+}
+
+/* Set up 'n' workers listening on 'ls' and start them, worker i
+   pinned to core i modulo the cores online */
+static int workers_start(int n, unsigned int batch,
+                         const struct listen_set *ls)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    g_stage_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_stage_wake < 0) { perror("eventfd"); return -1; }
+
+    for (int i = 0; i < n; i++) {
+        struct rx_worker *w = &g_worker[i];
+        w->id  = i;
+        w->cpu = cpus > 0 ? (int)(i % cpus) : -1;
+        pthread_mutex_init(&w->lock, NULL);
+        w->loop.worker  = w;
+        w->loop.timerfd = -1;
+        w->loop.sigfd   = -1;
+        w->loop.wakefd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (w->loop.wakefd < 0 ||
+            spsc_init(&w->queue, WORKER_QUEUE_LEN,
+                      sizeof(struct parsed_contact)) < 0 ||
+            rx_init(&w->loop, batch, -1) < 0) {
+            perror("worker");
+            return -1;
+        }
+        g_nworkers = i + 1;
+        rx_listen(&w->loop, ls);
+        if (rx_count(&w->loop) == 0) return -1;
+        if (thread_start(&w->tid, worker_thread, w) < 0) {
+            perror("worker thread");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Stop the workers, then trigger what they had queued */
+static void workers_stop(void)
+{
+    for (int i = 0; i < g_nworkers; i++) {
+        struct rx_worker *w = &g_worker[i];
+        atomic_store(&w->loop.stop, 1);
+        worker_wake(w);
+        if (w->tid) pthread_join(w->tid, NULL);
+    }
+    stage_drain();
+}
+
+static void workers_free(void)
+{
+    for (int i = 0; i < g_nworkers; i++) {
+        struct rx_worker *w = &g_worker[i];
+        rx_free(&w->loop);
+        close(w->loop.wakefd);
+        free(w->queue.slots);
+        pthread_mutex_destroy(&w->lock);
+    }
+    if (g_stage_wake >= 0) close(g_stage_wake);
+}
+
+/* Listen on 'ls' and process datagrams until SIGINT/SIGTERM, with
+   'workers' receive threads (0 = all on this one). */
+static int receive_main(unsigned int batch, const struct listen_set *ls,
+                        int workers)
+{
+    struct rx_loop l;
+    memset(&l, 0, sizeof(l));
+
+    /* The signals are read from the signalfd instead */
+    sigset_t sigs, old;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &sigs, &old);
+
+    if (workers > 0 && workers_start(workers, batch, ls) < 0) {
+        workers_stop();
+        workers_free();
+        return 1;
+    }
+    l.nworkers = g_nworkers;
+    l.wakefd   = g_recv_wake;
+    l.timerfd  = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    l.sigfd    = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (l.timerfd < 0 || l.sigfd < 0 ||
+        rx_init(&l, workers > 0 ? 1 : batch, g_stage_wake) < 0) {
+        perror("receive loop");
+        return 1;
+    }
+    if (!workers) {
+        rx_listen(&l, ls);
+        if (rx_count(&l) == 0) return 1;
+    }
+    const struct rx_loop *first = workers ? &g_worker[0].loop : &l;
+    for (int s = 0; s < LISTEN_MAX; s++)
+        if (first->sock[s].fd >= 0) {
+            udp_set_rcvbuf(first->sock[s].fd, l.rcvbuf, 1);
+            break;
+        }
+    printf("\n");
+    fflush(stdout);
+    l.last.at_ns    = now_ns();
+    l.last.contacts = g_state->stats.contacts;
+    l.last.bells    = g_state->stats.bells;
+    report_timer(&l, atomic_load(&g_stats_interval));
+
+    /* Everything the hot path needs is allocated by now.  Load the
+       time zone so the log thread's localtime_r() does not read it
+       on the first packet. */
+    tzset();
+    ALLOC_STEADY();
+
+    rx_run(&l);
+    workers_stop();
+
+    log_stop();                  /* summary after the last packet line */
+    struct recv_ring total = l.ring;
+    for (int i = 0; i < g_nworkers; i++) {
+        total.datagrams += g_worker[i].loop.ring.datagrams;
+        total.syscalls  += g_worker[i].loop.ring.syscalls;
+    }
+    double avg = total.syscalls ? (double)total.datagrams /
+                                  (double)total.syscalls : 0.0;
+    if (first->uring)
+        printf("\nReceived %llu datagrams in %llu io_uring completion "
+               "batches (avg %.2f per batch)\n",
+               total.datagrams, total.syscalls, avg);
+    else
+        printf("\nReceived %llu datagrams in %llu receive calls "
+               "(avg %.2f per call, batch %u)\n",
+               total.datagrams, total.syscalls, avg, batch);
+    rx_dump(stdout, &l);
+    workers_free();
+    rx_free(&l);
+    close(l.timerfd);
+    close(l.sigfd);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int batch = RECV_BATCH;
+    int force_scalar = 0;
+    const char *capture_path = NULL;
+    const char *log_path     = NULL;
+    const char *replay_path  = NULL;
+    const char *config_path  = NULL;
+    const char *state_path   = STATE_FILE;
+    double      replay_speed = 1.0;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:LSFql:w:r:x:C:c:m:R:s:W:Uh")) != -1) {
+        switch (opt) {
+        case 'b': {
+            long v = strtol(optarg, NULL, 10);
+            if (v < 1 || v > RECV_BATCH_MAX) {
+                fprintf(stderr, "Batch size must be 1..%d\n", RECV_BATCH_MAX);
+                return 1;
+            }
+            batch = (unsigned int)v;
+            break;
+        }
+        case 'L':
+            g_legacy_parser = 1;
+            break;
+        case 'S':
+            force_scalar = 1;
+            break;
+        case 'q':
+            g_quiet = 1;
+            break;
+        case 'l':
+            log_path = optarg;
+            break;
+        case 'F':
+            g_opt_backend = "fork";
+            break;
+        case 'w':
+            capture_path = optarg;
+            break;
+        case 'r':
+            replay_path = optarg;
+            break;
+        case 'x':
+            replay_speed = strtod(optarg, NULL);
+            if (replay_speed < 0) {
+                fprintf(stderr, "Replay speed must be >= 0\n");
+                return 1;
+            }
+            break;
+        case 'C':
+            config_path = optarg;
+            break;
+        case 'c':
+            g_opt_coalesce = (long)strtoul(optarg, NULL, 10);
+            break;
+        case 'm': {
+            long v = strtol(optarg, NULL, 10);
+            if (v < 1 || v > MIX_VOICES) {
+                fprintf(stderr, "Strikes per bell must be 1..%d\n",
+                        MIX_VOICES);
+                return 1;
+            }
+            g_opt_strikes = v;
+            break;
+        }
+        case 'R':
+            g_opt_bells = (long)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            state_path = optarg;
+            break;
+        case 'U':
+            g_opt_uring = 1;
+            break;
+        case 'W': {
+            long v = strtol(optarg, NULL, 10);
+            if (v < 0 || v > WORKER_MAX) {
+                fprintf(stderr, "Workers must be 0..%d\n", WORKER_MAX);
+                return 1;
+            }
+            g_opt_workers = v;
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    find_tag_select(force_scalar);
+
+    /* An explicit -C file must exist; the default one is optional */
+    struct config cfg;
+    if (config_load(config_path ? config_path : CONFIG_FILE, &cfg,
+                    config_path != NULL) < 0)
+        return 1;
+    if (!config_path) config_path = CONFIG_FILE;
+    config_apply(&cfg);
+
+    printf("=== DXLog Multiplier Listener ===\n");
+    printf("Config    : %s%s\n", config_path,
+           access(config_path, F_OK) == 0 ? "" : " (not found, defaults)");
+    if (replay_path)
+        printf("Replay    : %s, speed %g%s\n", replay_path, replay_speed,
+               replay_speed > 0 ? "x" : " (as fast as possible)");
+    else {
+        printf("Listen    : UDP");
+        for (int i = 0; i < cfg.listen.n; i++) {
+            char name[96];
+            printf("%s %s", i ? "," : "",
+                   endpoint_str(&cfg.listen.ep[i], name, sizeof(name)));
+        }
+        printf("\n");
+    }
+    printf("Trigger   : mult1/mult2/mult3 non-empty AND newqso=true%s\n",
+           cfg.trigger_local ? ", value not yet in the mult index" : "");
+    printf("Dedup     : last %d contacts", DEDUP_ENTRIES);
+    if (DEDUP_WINDOW_S) printf(" within %d s", DEDUP_WINDOW_S);
+    printf("\n");
+    if (cfg.tone)
+        printf("Sound     : %u Hz tone, %u ms, volume %.0f%%\n",
+               cfg.beep_freq, cfg.beep_ms, cfg.beep_volume * 100.0);
+    else
+        printf("Sound     : WAV file %s\n", cfg.wav_file);
+    for (int i = 0; i < 3; i++)
+        if (cfg.mult_sound[i][0])
+            printf("Sound m%d  : %s\n", i + 1, cfg.mult_sound[i]);
+    printf("Bells     : coalesce %u ms, up to %u strikes, ",
+           cfg.coalesce_ms, cfg.strikes);
+    if (cfg.bells_per_min)
+        printf("%u/min (burst %d)\n", cfg.bells_per_min, BELL_BURST);
+    else
+        printf("no rate limit\n");
+    if (!replay_path && cfg.recv_uring && uring_probe() < 0) {
+        printf("Receive   : io_uring not available (%s)\n", strerror(errno));
+        cfg.recv_uring = 0;
+    }
+    g_recv_uring = cfg.recv_uring;
+    if (!replay_path && g_recv_uring) {
+        printf("Receive   : io_uring multishot recvmsg, %d provided "
+               "buffers", URING_BUFFERS);
+        if (cfg.workers)
+            printf(", %u workers (SO_REUSEPORT, one core each)",
+                   cfg.workers);
+        printf("\n");
+    } else if (!replay_path) {
+        printf("Receive   : %s, batch %u", batch > 1 ? "recvmmsg" : "recvmsg",
+               batch);
+        if (cfg.workers)
+            printf(", %u workers (SO_REUSEPORT, one core each)",
+                   cfg.workers);
+        printf("\n");
+    }
+    /* SO_REUSEPORT spreads unicast senders only */
+    for (int i = 0; !replay_path && cfg.workers > 1 && i < cfg.listen.n; i++) {
+        if (!endpoint_takes_groups(&cfg.listen.ep[i])) continue;
+        char name[96];
+        fprintf(stderr, "Warning: %s takes broadcasts, and worker 0 parses "
+                "every one of them; the workers share only unicast "
+                "traffic\n",
+                endpoint_str(&cfg.listen.ep[i], name, sizeof(name)));
+        break;
+    }
+    /* -L finds <contactinfo> anywhere; the filter would drop it
+       unless it is the root */
+    if (!replay_path && cfg.filter && g_legacy_parser) {
+        printf("Filter    : off, -L reads <contactinfo> anywhere in a "
+               "datagram, the filter only as its root\n");
+        cfg.filter = 0;
+    }
+    if (!replay_path && cfg.filter) {
+        bpf_build(&g_filter[0], &cfg, AF_INET);
+        bpf_build(&g_filter[1], &cfg, AF_INET6);
+        if (g_filter[0].overflow || g_filter[1].overflow) {
+            fprintf(stderr, "Socket filter longer than %d instructions\n",
+                    FILTER_INSNS);
+            return 1;
+        }
+        g_filter_on = 1;
+        printf("Filter    : BPF, %u/%u instructions (IPv4/IPv6), ",
+               g_filter[0].n, g_filter[1].n);
+        const char *sep = "<";
+        for (int t = MSG_NONE + 1; t < MSG_TYPES; t++) {
+            if (!msg_handlers[t]) continue;
+            printf("%s%s", sep, msg_roots[t].root);
+            sep = "|";
+        }
+        printf("> in the first %d bytes", ROOT_SCAN);
+        if (cfg.max_length)
+            printf(", at most %u bytes", cfg.max_length);
+        for (int i = 0; i < cfg.allow.n; i++) {
+            char net[64];
+            printf("%s%s", i ? ", " : ", from ",
+                   allow_net_str(&cfg.allow.net[i], net, sizeof(net)));
+        }
+        printf("\n");
+    }
+    if (capture_path)
+        printf("Capture   : %s\n", capture_path);
+    printf("Parser    : %s\n",
+           g_legacy_parser ? "legacy (rescan per field)"
+                           : "root-element dispatch, single pass");
+    printf("Tag scan  : %s\n", find_tag_name);
+
+    /* A replay never touches the state of the live listener */
+    if (!replay_path && *state_path) {
+        uint64_t t0   = now_ns();
+        int      warm = state_open(state_path);
+        if (warm > 0) {
+            const struct state_file *s = g_state;
+            printf("State     : %s, %llu contacts, %u mult values, "
+                   "%u dedup keys (mapped in %.2f ms)%s\n", state_path,
+                   (unsigned long long)s->stats.contacts, s->mults.count,
+                   s->dedup.count, (double)(now_ns() - t0) / 1e6,
+                   s->clean ? "" : ", not closed cleanly");
+        } else if (warm == 0) {
+            printf("State     : %s (new)\n", state_path);
+        }
+        g_state->clean = 0;
+        g_state->stats.starts++;
+    }
+    if (g_state_fd < 0)
+        printf("State     : in memory only\n");
+    fflush(stdout);
+
+    if (capture_path && !replay_path && capture_open(capture_path) < 0)
+        return 1;
+    if (!g_quiet && log_start(log_path) < 0)
+        return 1;
+
+    /* Failure is not fatal: the audio thread retries on each bell */
+    if (sound_init(&cfg, cfg.backend) < 0)
+        fprintf(stderr, "Warning: sound output not ready\n");
+    printf("Output    : %s, %s (%s)\n\n", g_out->name, g_out->desc,
+           g_out_device);
+    fflush(stdout);
+
+    pthread_t audio_tid;
+    if (audio_start(&audio_tid) < 0) {
+        perror("audio thread");
+        return 1;
+    }
+    g_recv_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_recv_wake < 0) {
+        perror("eventfd");
+        return 1;
+    }
+    pthread_t config_tid;
+    if (config_start(&config_tid, config_path, &cfg) < 0) {
+        perror("config thread");
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;   /* no SA_RESTART: interrupt sleep */
+    sigaction(SIGINT,  &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = on_usr1_signal;   /* stats, during a replay */
+    sigaction(SIGUSR1, &sa, NULL);
+
+    /* The receive loop takes these through a signalfd instead */
+    int rc = replay_path ? (replay_file(replay_path, replay_speed) < 0)
+                         : receive_main(batch, &cfg.listen,
+                                        (int)cfg.workers);
+
+    log_stop();
+    if (g_triggers_dropped)
+        printf("Dropped %llu bell triggers (audio queue full)\n",
+               g_triggers_dropped);
+    if (g_log_dropped)
+        printf("Dropped %llu log lines (log queue full)\n", g_log_dropped);
+#ifdef ALLOC_DEBUG
+    printf("Heap allocations: %lu total, %lu on the receive path after "
+           "startup\n", atomic_load(&g_alloc_count),
+           atomic_load(&g_alloc_late));
+#endif
+    fflush(stdout);
+    config_stop(config_tid);
+    close(g_recv_wake);
+    audio_stop(audio_tid);
+    sched_report(&g_sched);
+    sound_shutdown();
+    capture_close();
+    lat_dump(stdout);
+    dedup_dump(stdout, &g_state->dedup);
+    mult_dump(stdout, &g_state->mults);
+    if (g_state_fd >= 0)
+        printf("State     : %llu contacts, %llu bells over %llu runs, "
+               "saved to %s\n",
+               (unsigned long long)g_state->stats.contacts,
+               (unsigned long long)g_state->stats.bells,
+               (unsigned long long)g_state->stats.starts, state_path);
+    state_close();
+    return rc;
+}
+#endif /* LISTENER_NO_MAIN */